@@ -0,0 +1,408 @@
+// Batch.cpp
+
+#include "Batch.h"
+#include "Config.h"
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QTransform>
+#include <QtConcurrent/QtConcurrent>
+#include <string.h>
+
+//
+// Replace pixels close to white with the background color
+//
+bool Batch::removeBG(Page &page, int threshold, QColor bg)
+{
+    QImage mask = page.colorSelect(QColor(Qt::white).rgb(), threshold);
+    page.push(Page::maskRect(mask));
+    page.applyMask(mask, bg);
+    return true;
+}
+
+//
+// Remove speckles
+//
+bool Batch::despeckle(Page &page, int area, QColor bg)
+{
+    int blobs;
+    QImage mask = page.despeckle(area, false, &blobs);
+    if (blobs == 0)
+        return false;
+    page.push(Page::maskRect(mask));
+    page.applyMask(mask, bg);
+    return true;
+}
+
+//
+// Remove voids
+//
+bool Batch::devoid(Page &page, int area, QColor fg)
+{
+    int blobs;
+    QImage mask = page.despeckle(area, true, &blobs);
+    if (blobs == 0)
+        return false;
+    page.push(Page::maskRect(mask));
+    page.applyMask(mask, fg);
+    return true;
+}
+
+//
+// Straighten the text
+//
+bool Batch::deskew(Page &page)
+{
+    float angle = page.calcDeskew(true);
+    if (angle == 0.0)
+        return false;
+    page.push();
+    page.applyDeskew(angle);
+    return true;
+}
+
+//
+// Convert to grayscale
+//
+bool Batch::toGrayscale(Page &page)
+{
+    page.push();
+    page.toGrayscale();
+    return true;
+}
+
+//
+// Convert to binary using Otsu's algorithm or an adaptive threshold
+//
+bool Batch::toBinary(Page &page, bool adaptive, int blur, int kernel)
+{
+    // If last operation converted to mono, undo it
+    if ((page.m_img.format() == QImage::Format_Mono) && (page.peekFormat() != QImage::Format_Mono))
+        page.undo();
+
+    page.push();
+    page.toBinary(adaptive, blur, kernel);
+    return true;
+}
+
+//
+// Convert to binary using diffuse dithering
+//
+bool Batch::toDithered(Page &page)
+{
+    // If last operation converted to mono, undo it
+    if ((page.m_img.format() == QImage::Format_Mono) && (page.peekFormat() != QImage::Format_Mono))
+        page.undo();
+
+    page.push();
+    page.toDithered();
+    return true;
+}
+
+//
+// Center image on page
+//
+bool Batch::center(Page &page, QColor bg)
+{
+    page.push();
+    page.doCenter(bg);
+    return true;
+}
+
+//
+// Rotate by multiples of 90 degrees
+//  1 = 90
+//  2 = 180
+//  3 = 270
+//
+bool Batch::rotate(Page &page, int rot)
+{
+    QTransform tmat = QTransform().rotate(rot * 90.0);
+    page.push();
+    page.m_img = page.m_img.transformed(tmat, Qt::SmoothTransformation);
+    if (rot != 2)
+        page.scaleFactor = 0.0; // Assume the pages dimensions have changed
+    return true;
+}
+
+//
+// Mirror the image
+//  1 = horizontal
+//  2 = vertical
+//  3 = both
+//
+bool Batch::mirror(Page &page, int dir)
+{
+    page.push();
+    page.m_img = page.m_img.mirrored(((dir & 1) == 1), ((dir & 2) == 2));
+    return true;
+}
+
+//
+// Write an image, renaming an existing file to backupName first
+//
+bool Batch::saveImage(const QImage &img, const QString &fileName, const QString &backupName)
+{
+    // Attempt to create backup
+    if (QFileInfo(fileName).exists())
+    {
+        // If original isn't writeable, flag error
+        if (!QFileInfo(fileName).isWritable())
+            return false;
+
+        // Delete the backup if it is writable
+        if (QFileInfo(backupName).exists() && QFileInfo(backupName).isWritable())
+            QFile(backupName).remove();
+
+        // Rename original to backup
+        if (QFile(fileName).rename(backupName) == false)
+            return false;
+    }
+
+    // Save image to <fileName>
+    QImageWriter writer(fileName);
+    //writer.setCompression(100);     // TIF is LZW, no Group 4 option
+    return writer.write(img);
+}
+
+//
+// Check for --batch before the application is created, so that no
+// display is needed
+//
+bool Batch::requested(int argc, char *argv[])
+{
+    for(int idx=1; idx<argc; idx++)
+        if (strcmp(argv[idx], "--batch") == 0)
+            return true;
+    return false;
+}
+
+//
+// Look up an operation by its menu slot name, using the saved settings
+//
+static Batch::Op makeOp(const QString &name)
+{
+    int bgThreshold = Config::bgRemoveThreshold;
+    int speckle = Config::despeckleArea;
+    int voids = Config::devoidArea;
+    int blur = Config::blurRadius;
+    int adaptiveBlur = Config::adaptiveBlurRadius;
+    int kernel = Config::kernelSize;
+    QColor fg = Config::fgColor;
+    QColor bg = Config::bgColor;
+
+    if (name == "removeBG")
+        return [bgThreshold, bg](Page &page) { return Batch::removeBG(page, bgThreshold, bg); };
+    if (name == "despeckle")
+        return [speckle, bg](Page &page) { return Batch::despeckle(page, speckle, bg); };
+    if (name == "devoid")
+        return [voids, fg](Page &page) { return Batch::devoid(page, voids, fg); };
+    if (name == "deskew")
+        return Batch::deskew;
+    if (name == "toGrayscale")
+        return Batch::toGrayscale;
+    if (name == "toBinary")
+        return [blur](Page &page) { return Batch::toBinary(page, false, blur); };
+    if (name == "toAdaptive")
+        return [adaptiveBlur, kernel](Page &page) { return Batch::toBinary(page, true, adaptiveBlur, kernel); };
+    if (name == "toDithered")
+        return Batch::toDithered;
+    if (name == "centerPage")
+        return [bg](Page &page) { return Batch::center(page, bg); };
+    if (name == "rotateCW")
+        return [](Page &page) { return Batch::rotate(page, 1); };
+    if (name == "rotateCCW")
+        return [](Page &page) { return Batch::rotate(page, 3); };
+    if (name == "rotate180")
+        return [](Page &page) { return Batch::rotate(page, 2); };
+    if (name == "mirrorHoriz")
+        return [](Page &page) { return Batch::mirror(page, 1); };
+    if (name == "mirrorVert")
+        return [](Page &page) { return Batch::mirror(page, 2); };
+    return Batch::Op();
+}
+
+//
+// Expand directories into the image files they hold, sorted by name
+//
+static QStringList expandFiles(const QStringList &paths)
+{
+    QStringList filters;
+    foreach(QByteArray format, QImageReader::supportedImageFormats())
+        filters << "*." + QString::fromLatin1(format);
+
+    QStringList files;
+    foreach(QString path, paths)
+    {
+        if (QFileInfo(path).isDir())
+        {
+            QDir dir(path);
+            foreach(QString name, dir.entryList(filters, QDir::Files, QDir::Name))
+                files << dir.filePath(name);
+        }
+        else
+            files << path;
+    }
+    return files;
+}
+
+//
+// Apply operations to files without a window
+//     Files are replaced with a .bak backup like Save, or written to
+//     another directory like Save To. Pages are read, processed and
+//     written on the thread pool, one page per thread.
+//
+int Batch::run(const QStringList &args)
+{
+    QTextStream err(stderr);
+    Config::LoadConfig();
+
+    // Pages are dropped once written, so only keep the newest undo step,
+    // which toBinary and toDithered use to replace an earlier conversion.
+    // The edit count behind Page::modified is unaffected.
+    Config::undoBudget = 0;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Apply page operations to files without opening a window.\n"
+                                     "Settings such as thresholds and colors are the ones saved by the editor.");
+    parser.addHelpOption();
+    QCommandLineOption batchOpt("batch", "Run without a window.");
+    QCommandLineOption opsOpt("ops", "Comma separated operations, applied in order: removeBG, despeckle, devoid, "
+                              "deskew, toGrayscale, toBinary, toAdaptive, toDithered, centerPage, rotateCW, "
+                              "rotateCCW, rotate180, mirrorHoriz, mirrorVert.", "list");
+    QCommandLineOption threadsOpt("threads", "Pages processed at once, defaults to the number of cores.", "count");
+    QCommandLineOption outOpt("out", "Write results into this directory instead of replacing the originals.", "dir");
+    parser.addOption(batchOpt);
+    parser.addOption(opsOpt);
+    parser.addOption(threadsOpt);
+    parser.addOption(outOpt);
+    parser.addPositionalArgument("files", "Image files or directories to process.", "files...");
+    parser.process(args);
+
+    // Operations
+    QList<Op> ops;
+    foreach(QString name, parser.value(opsOpt).split(','))
+    {
+        name = name.trimmed();
+        if (name.isEmpty())
+            continue;
+        Op op = makeOp(name);
+        if (!op)
+        {
+            err << "Unknown operation " << name << "\n";
+            return 2;
+        }
+        ops.append(op);
+    }
+    QString outDir = parser.value(outOpt);
+    if (ops.isEmpty() && outDir.isEmpty())
+    {
+        err << "Nothing to do, give --ops or --out\n";
+        return 2;
+    }
+
+    // Files
+    QStringList files = expandFiles(parser.positionalArguments());
+    if (files.isEmpty())
+    {
+        err << "No files given\n";
+        return 2;
+    }
+
+    // Save To keeps only the base name, so two inputs must not share one
+    if (!outDir.isEmpty())
+    {
+        QHash<QString, QString> names;
+        foreach(QString file, files)
+        {
+            QString name = QFileInfo(file).fileName();
+            if (names.contains(name))
+            {
+                err << names.value(name) << " and " << file << " would both be written to "
+                    << QDir(outDir).filePath(name) << "\n";
+                return 2;
+            }
+            names.insert(name, file);
+        }
+    }
+    if (!outDir.isEmpty() && !QDir().mkpath(outDir))
+    {
+        err << "Cannot create " << outDir << "\n";
+        return 1;
+    }
+
+    // Threads
+    int threads = QThread::idealThreadCount();
+    if (parser.isSet(threadsOpt))
+    {
+        bool ok;
+        threads = parser.value(threadsOpt).toInt(&ok);
+        if (!ok || (threads < 1))
+        {
+            err << "Bad thread count " << parser.value(threadsOpt) << "\n";
+            return 2;
+        }
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(threads);
+
+    // Process every file
+    struct Job
+    {
+        QString fileName;
+        QString error;
+        bool written = false;
+    };
+    QVector<Job> jobs(files.count());
+    for(int idx=0; idx<files.count(); idx++)
+        jobs[idx].fileName = files.at(idx);
+
+    QtConcurrent::blockingMap(jobs, [&ops, outDir](Job &job) {
+        Page page(job.fileName);
+        if (page.m_img.isNull())
+        {
+            job.error = "cannot read";
+            return;
+        }
+        page.normalize();
+        foreach(const Op &op, ops)
+            op(page);
+
+        // Save skips unchanged pages, Save To writes all of them
+        QString fileName = job.fileName;
+        if (outDir.isEmpty())
+        {
+            if (!page.modified())
+                return;
+        }
+        else
+            fileName = QDir(outDir).filePath(QFileInfo(job.fileName).fileName());
+        if (!saveImage(page.m_img, fileName, fileName + ".bak"))
+        {
+            job.error = "cannot write " + fileName;
+            return;
+        }
+        job.written = true;
+    });
+
+    // Report in file order
+    QTextStream out(stdout);
+    int errors = 0;
+    foreach(const Job &job, jobs)
+    {
+        if (!job.error.isEmpty())
+        {
+            err << job.fileName << ": " << job.error << "\n";
+            errors++;
+        }
+        else
+            out << job.fileName << (job.written ? ": written\n" : ": unchanged\n");
+    }
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+// Batch.h
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "Page.h"
+#include <QColor>
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+//
+// Page operations shared by the Bookmarks batch engine and the
+// headless command line mode
+//     Each returns false if it left the page untouched
+//
+namespace Batch
+{
+    typedef std::function<bool(Page &)> Op;
+
+    bool removeBG(Page &page, int threshold, QColor bg);
+    bool despeckle(Page &page, int area, QColor bg);
+    bool devoid(Page &page, int area, QColor fg);
+    bool deskew(Page &page);
+    bool toGrayscale(Page &page);
+    bool toBinary(Page &page, bool adaptive, int blur, int kernel = 1);
+    bool toDithered(Page &page);
+    bool center(Page &page, QColor bg);
+    bool rotate(Page &page, int rot);
+    bool mirror(Page &page, int dir);
+
+    bool saveImage(const QImage &img, const QString &fileName, const QString &backupName);
+
+    // Entry for Tiffany --batch
+    bool requested(int argc, char *argv[]);
+    int run(const QStringList &args);
+}
+
+#endif // BATCH_H
@@ -1,20 +1,29 @@
 #include "Bookmarks.h"
+#include "Batch.h"
 #include "Config.h"
 #include <QDebug>
 #include <QFileDialog>
 #include <QImage>
-#include <QImageWriter>
+#include <QImageReader>
 #include <QInputDialog>
 #include <QMessageBox>
 #include <QPainter>
-#include <QPainterPath>
+#include <QtConcurrent/QtConcurrent>
 
 Bookmarks::Bookmarks(QWidget * parent) : QListWidget(parent)
 {
+    // Every entry is the same size, which keeps layout cheap on long lists
+    setUniformItemSizes(true);
+    setLayoutMode(QListView::Batched);
+
+    // Batch engine reporting
+    connect(&batchWatcher, &QFutureWatcher<void>::progressValueChanged, this, [this](int val) { emit progressSig("", val); });
+    connect(&batchWatcher, &QFutureWatcher<void>::finished, this, &Bookmarks::batchFinished);
 }
 
 Bookmarks::~Bookmarks()
 {
+    batchWatcher.waitForFinished();
 }
 
 // Capture/Release keyboard
@@ -49,16 +58,26 @@ void Bookmarks::itemSelectionChanged()
 
     // Tell viewer what page to show
     if (items.count() > 0)
+    {
         emit changePageSig(items.last());
+        cache.touch(items.last());
+        trimCache();
+    }
     else
         emit changePageSig(nullptr);
 }
 
 //
 // Load files into bookmark viewer
+//     Files are decoded on the thread pool and inserted in order as they
+//     complete, so the first pages can be viewed while the rest load
 //
 void Bookmarks::readFiles(QString cmd)
 {
+    // Only one load at a time
+    if (!loadNames.isEmpty())
+        return;
+
     // For replace or insert, get list of items
     QVector<int> rows;
     if ((cmd == "Insert") || (cmd == "Replace"))
@@ -75,7 +94,6 @@ void Bookmarks::readFiles(QString cmd)
     }
     else // For open, get last item
         rows.append(count());
-    int firstIdx = rows[0];
 
     // Popup file dialog
     QStringList filenames = QFileDialog::getOpenFileNames(this, cmd + " Files", "",
@@ -83,87 +101,201 @@ void Bookmarks::readFiles(QString cmd)
     if (filenames.isEmpty())
         return;
 
+    // Pick up edits still pending in the Viewer
+    emit syncPageSig();
+
+    // Setup loader
+    loadCmd = cmd;
+    loadNames = filenames;
+    loadErrors.clear();
+    loadRows = rows;
+    loadDone.clear();
+    loadLazy = Config::lazyLoad;
+    loadFirstIdx = rows[0];
+    loadNext = 0;
+    loadInsert = 0;
+    loadBytes = 0;
+
     // Add progress to status bar
     emit progressSig("Reading...", filenames.count());
 
-    // Open each file in turn and add to listWidget
-    int progress = 1;
-    for(int idx=0; idx < filenames.count(); idx++)
+    // Start first batch of reads
+    loadStart();
+}
+
+//
+// Read a file and prepare it for display, runs on the thread pool
+//     Lazy pages only decode a thumbnail, the full image is read
+//     when the page is first viewed or edited. Files read before
+//     take their icon from the disk cache without decoding at all.
+//
+Bookmarks::LoadJob Bookmarks::loadPage(QString fileName, bool lazy)
+{
+    LoadJob job;
+    QString key = ThumbService::fileKey(fileName);
+    QImage cached = ThumbService::loadIcon(key);
+    if (lazy)
+    {
+        if (!cached.isNull())
+        {
+            job.page.m_fileName = fileName;
+            job.icon = cached;
+            return job;
+        }
+
+        QImageReader reader(fileName);
+        QImage::Format format = reader.imageFormat();
+        QSize size = reader.size();
+        if (size.isValid())
+            reader.setScaledSize(size.scaled(ICON_SIZE, ICON_SIZE, Qt::KeepAspectRatio));
+        QImage thumb = reader.read();
+        if (!thumb.isNull())
+        {
+            // Predict what Page::normalize will do with indexed images
+            if (format == QImage::Format_Indexed8)
+                format = thumb.allGray() ? QImage::Format_Grayscale8 : QImage::Format_RGB32;
+            job.page.m_fileName = fileName;
+            job.icon = ThumbService::iconImage(thumb, false, format);
+            ThumbService::storeIcon(key, job.icon);
+        }
+        return job;
+    }
+
+    job.page = Page(fileName);
+    if (!job.page.m_img.isNull())
     {
-        // Read image and add to listwidget
-        Page page = Page(filenames.at(idx));
-        if (page.m_img.isNull())
-            QMessageBox::information(this, "Tiffany", QString("Cannot load %1.").arg(filenames.at(idx)));
+        job.page.normalize();
+        if (!cached.isNull())
+            job.icon = cached;
         else
         {
-            // Cannot paint on indexed8, so convert to better format
-            if (page.m_img.format() == QImage::Format_Indexed8)
-            {
-                if (page.m_img.allGray())
-                    page.m_img = page.m_img.convertToFormat(QImage::Format_Grayscale8);
-                else
-                    page.m_img = page.m_img.convertToFormat(QImage::Format_RGB32);
-            }
+            job.icon = ThumbService::iconImage(job.page.m_img, false);
+            ThumbService::storeIcon(key, job.icon);
+        }
+    }
+    return job;
+}
 
-            // If image has 2 colors, but they aren't black and white, promote to RGB
-            if ((page.m_img.format() == QImage::Format_Mono) && (page.m_img.colorCount() == 2))
-            {
-                if ((page.m_img.color(0) == 0xFFFFFFFF) && (page.m_img.color(1) == 0xFF000000))
-                    ;
-                else if ((page.m_img.color(0) == 0xFF000000) && (page.m_img.color(1) == 0xFFFFFFFF))
-                    ;
-                else
-                    page.m_img = page.m_img.convertToFormat(QImage::Format_RGB32);
-            }
+//
+// Start reading more files, keeping the decoded but not yet inserted
+// pages below MAX_LOAD_BYTES
+//
+void Bookmarks::loadStart()
+{
+    int maxJobs = QThreadPool::globalInstance()->maxThreadCount() * 2;
+    while ((loadNext < loadNames.count()) && (loadNext - loadInsert < maxJobs))
+    {
+        // Estimate size from the header, always allow one page in flight
+        qint64 bytes = 0;
+        if (!loadLazy)
+        {
+            QSize size = QImageReader(loadNames.at(loadNext)).size();
+            if (size.isValid())
+                bytes = (qint64)size.width() * size.height() * 4;
+        }
+        if ((loadNext > loadInsert) && (loadBytes + bytes > MAX_LOAD_BYTES))
+            break;
+        loadBytes += bytes;
+
+        // Queue the read
+        int idx = loadNext;
+        QFutureWatcher<LoadJob> *watcher = new QFutureWatcher<LoadJob>(this);
+        connect(watcher, &QFutureWatcher<LoadJob>::finished, this, [this, watcher, idx, bytes]() {
+            LoadJob job = watcher->result();
+            job.bytes = bytes;
+            loadDone.insert(idx, job);
+            watcher->deleteLater();
+            insertLoaded();
+        });
+        watcher->setFuture(QtConcurrent::run(&Bookmarks::loadPage, loadNames.at(idx), loadLazy));
+        loadNext++;
+    }
+}
+
+//
+// Add finished pages to the list in file order
+//
+void Bookmarks::insertLoaded()
+{
+    while (loadDone.contains(loadInsert))
+    {
+        LoadJob job = loadDone.take(loadInsert);
+        QString fileName = loadNames.at(loadInsert);
+        loadBytes -= job.bytes;
 
+        if (job.icon.isNull())
+            loadErrors.append(fileName);
+        else
+        {
             // Remove the next item to be replaced
-            if (cmd == "Replace")
-                delete takeItem(rows[0]);
+            if (loadCmd == "Replace")
+                removeItem(item(loadRows[0]));
 
             // Build list item and insert
-            QListWidgetItem *newItem = new QListWidgetItem();
-            newItem->setToolTip(filenames.at(idx));
-            newItem->setData(Qt::UserRole, QVariant::fromValue(page));
-            newItem->setIcon(makeIcon(page.m_img, page.modified()));
-            QString txt = QFileInfo(filenames.at(idx)).fileName();
+            PageItem *newItem = new PageItem(job.page);
+            newItem->setToolTip(fileName);
+            newItem->setIconImage(job.icon);
+            QString txt = QFileInfo(fileName).fileName();
             int suffix = txt.lastIndexOf(".");
             if (suffix > 0)
                 txt = txt.left(suffix);
             if (txt.length() >= 13)
                 txt = txt.left(5) + ".." + txt.right(5);
             newItem->setText(txt);
-            insertItem(rows[0], newItem);
+            insertItem(loadRows[0], newItem);
+            if (!loadLazy)
+            {
+                cache.touch(newItem);
+                trimCache();
+            }
+
+            // Select first item read in so it can be viewed right away
+            if (loadRows[0] == loadFirstIdx)
+                setCurrentRow(loadFirstIdx, QItemSelectionModel::ClearAndSelect);
 
             // Update row for next item
-            if (cmd == "Replace")
+            if (loadCmd == "Replace")
             {
-                if (rows.count() > 1)
-                    rows.remove(0);
+                if (loadRows.count() > 1)
+                    loadRows.remove(0);
                 else
                     // Out of replacement items, switch to insert
-                    cmd = "Insert";
+                    loadCmd = "Insert";
             }
 
             // Next item goes after current one
-            if ((cmd == "Open") || (cmd == "Insert"))
-                rows[0] = rows[0] + 1;
+            if ((loadCmd == "Open") || (loadCmd == "Insert"))
+                loadRows[0] = loadRows[0] + 1;
         }
 
         // Update progress bar
-        emit progressSig("", progress);
-        progress = progress + 1;
+        loadInsert++;
+        emit progressSig("", loadInsert);
+    }
+
+    // Keep the pool busy
+    if (loadInsert < loadNames.count())
+    {
+        loadStart();
+        return;
     }
 
     // Remove any remaining selections
-    if (cmd == "Replace")
-        for(int idx=rows.count()-1;idx >= 0; idx--)
-            delete takeItem(rows[idx]);
+    if (loadCmd == "Replace")
+        for(int idx=loadRows.count()-1;idx >= 0; idx--)
+            removeItem(item(loadRows[idx]));
+    loadNames.clear();
+
+    // Icons stored by this import may have pushed the disk cache over its cap
+    QThreadPool::globalInstance()->start(&ThumbService::trimIcons);
 
     // Cleanup status bar
     emit progressSig("", -1);
 
-    // Select first item read in
-    setCurrentRow(firstIdx, QItemSelectionModel::ClearAndSelect);
+    // Report files that couldn't be read
+    foreach(QString fileName, loadErrors)
+        QMessageBox::information(this, "Tiffany", QString("Cannot load %1.").arg(fileName));
+    loadErrors.clear();
 }
 
 //
@@ -193,33 +325,20 @@ void Bookmarks::replaceFiles()
 // Common save routine
 bool Bookmarks::saveCommon(QListWidgetItem* itemPtr, QString &fileName, QString &backupName)
 {
-    // Attempt to create backup
-    if (QFileInfo(fileName).exists())
-    {
-        // If original isn't writeable, flag error
-        if (!QFileInfo(fileName).isWritable())
-            return false;
-
-        // Delete the backup if it is writable
-        if (QFileInfo(backupName).exists() && QFileInfo(backupName).isWritable())
-            QFile(backupName).remove();
-
-        // Rename original to backup
-        if (QFile(fileName).rename(backupName) == false)
-            return false;
-    }
+    // Image must be in memory before the original is renamed
+    Page &page = PageItem::pageOf(itemPtr);
+    if (!page.load())
+        return false;
+    cache.touch(itemPtr);
 
-    // Save image to <fileName>
-    Page page = itemPtr->data(Qt::UserRole).value<Page>();
-    QImageWriter writer(fileName);
-    //writer.setCompression(100);     // TIF is LZW, no Group 4 option
-    if (writer.write(page.m_img) == false)
+    // Write with backup
+    if (!Batch::saveImage(page.m_img, fileName, backupName))
         return false;
 
     // Update item
     page.flush();
-    itemPtr->setData(Qt::UserRole, QVariant::fromValue(page));
-    itemPtr->setIcon(makeIcon(page.m_img, false));
+    page.m_fileName = fileName;
+    thumbs.request(itemPtr, page.m_img, false, QRect());
 
     // No errors
     return true;
@@ -231,6 +350,7 @@ bool Bookmarks::saveCommon(QListWidgetItem* itemPtr, QString &fileName, QString
 void Bookmarks::saveFiles()
 {
     int writeErr = 0;
+    emit syncPageSig();
 
     // Get list of all selected items
     QList<QListWidgetItem*> selection = selectedItems();
@@ -247,8 +367,7 @@ void Bookmarks::saveFiles()
     foreach(QListWidgetItem* itemPtr, selection)
     {
         // Skip if unchanged
-        Page page = itemPtr->data(Qt::UserRole).value<Page>();
-        if (!page.modified())
+        if (!PageItem::pageOf(itemPtr).modified())
             continue;
 
         // Get the filenames
@@ -278,6 +397,7 @@ void Bookmarks::saveFiles()
 void Bookmarks::saveToDir()
 {
     int writeErr = 0;
+    emit syncPageSig();
 
     // Get list of all selected items
     QList<QListWidgetItem*> selection = selectedItems();
@@ -327,12 +447,10 @@ void Bookmarks::saveToDir()
 //
 bool Bookmarks::anyModified()
 {
+    emit syncPageSig();
     for(int idx=0; idx<count(); idx++)
-    {
-        Page page = item(idx)->data(Qt::UserRole).value<Page>();
-        if (page.modified())
+        if (PageItem::pageOf(item(idx)).modified())
             return true;
-    }
     return false;
 }
 
@@ -359,12 +477,9 @@ void Bookmarks::selectOdd()
 //
 void Bookmarks::selectModified()
 {
-    Page tmp;
+    emit syncPageSig();
     for(int idx=0; idx < count(); idx++)
-    {
-        tmp = item(idx)->data(Qt::UserRole).value<Page>();
-        item(idx)->setSelected( tmp.modified() );
-    }
+        item(idx)->setSelected( PageItem::pageOf(item(idx)).modified() );
 }
 
 //
@@ -372,12 +487,16 @@ void Bookmarks::selectModified()
 //
 void Bookmarks::deleteSelection()
 {
+    // Rows must not move while files are being read
+    if (!loadNames.isEmpty())
+        return;
+
+    emit syncPageSig();
     QList<QListWidgetItem*> items = selectedItems();
     foreach(QListWidgetItem* item, items)
     {
         // Skip if changed
-        Page page = item->data(Qt::UserRole).value<Page>();
-        if (page.modified())
+        if (PageItem::pageOf(item).modified())
         {
             QMessageBox::StandardButton resBtn = QMessageBox::question( this, "Tiffany",
                     item->toolTip() + " has been modified, are you sure?\n",
@@ -385,10 +504,10 @@ void Bookmarks::deleteSelection()
             if (resBtn == QMessageBox::Cancel)
                 break;
             if (resBtn == QMessageBox::Yes)
-                delete item;
+                removeItem(item);
         }
         else
-            delete item;
+            removeItem(item);
     }
     // Since entire selection was deleted, select whatever the listwidget picked as current
     if (currentItem() != nullptr)
@@ -418,42 +537,23 @@ void Bookmarks::blankPage()
     QString text = QInputDialog::getText(this, tr("New Page Contents"),
                                          "", QLineEdit::Normal,
                                          "BLANK", &ok);
-    if (ok)
-    {
-        // Add progress to status bar
-        emit progressSig("Blanking...", selection.count());
-
-        // Blank each page in turn
-        int progress = 1;
-        foreach(QListWidgetItem* item, selection)
-        {
-            Page page = item->data(Qt::UserRole).value<Page>();
-            page.push();
-            QImage img = page.m_img;
-
-            // Erase and draw text
-            QPainter p(&img);
-            p.fillRect(img.rect(), Config::bgColor);
-            p.setPen(Config::fgColor);
-            p.setFont(Config::textFont);
-            p.drawText(img.rect(), Qt::AlignCenter, text);
-            p.end();
-
-            // Update list with new image
-            page.m_img = img;
-            item->setData(Qt::UserRole, QVariant::fromValue(page));
-            item->setIcon(makeIcon(page.m_img, page.modified()));
-
-            // Update progress
-            emit progressSig("", progress);
-            progress = progress + 1;
-        }
-        // Cleanup status bar
-        emit progressSig("", -1);
+    if (!ok)
+        return;
 
-        // Update Viewer
-        emit updatePageSig(false);
-    }
+    // Erase and draw text on each page
+    QColor bg = Config::bgColor;
+    QColor fg = Config::fgColor;
+    QFont font = Config::textFont;
+    runBatch("Blanking...", selection, [text, bg, fg, font](Page &page) {
+        page.push();
+        QPainter p(&page.m_img);
+        p.fillRect(page.m_img.rect(), bg);
+        p.setPen(fg);
+        p.setFont(font);
+        p.drawText(page.m_img.rect(), Qt::AlignCenter, text);
+        p.end();
+        return true;
+    }, false);
 }
 
 //
@@ -471,30 +571,11 @@ void Bookmarks::removeBG()
     if (!Config::multiPage)
         return;
 
-    // Add progress to status bar
-    emit progressSig("Background...", selection.count());
-
-    // Blank each page in turn
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        Page page = item->data(Qt::UserRole).value<Page>();
-        QImage mask = page.colorSelect(QColor(Qt::white).rgb(), Config::bgRemoveThreshold);
-        page.push();
-        page.applyMask(mask, Config::bgColor);
-
-        item->setData(Qt::UserRole, QVariant::fromValue(page));
-        item->setIcon(makeIcon(page.m_img, page.modified()));
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(false);
+    int threshold = Config::bgRemoveThreshold;
+    QColor bg = Config::bgColor;
+    runBatch("Background...", selection, [threshold, bg](Page &page) {
+        return Batch::removeBG(page, threshold, bg);
+    }, false);
 }
 
 //
@@ -502,8 +583,6 @@ void Bookmarks::removeBG()
 //
 void Bookmarks::despeckle()
 {
-    int blobs;
-
     // Get list of all selected items
     QList<QListWidgetItem*> selection = selectedItems();
     if (selection.count() == 0)
@@ -514,32 +593,11 @@ void Bookmarks::despeckle()
     if (!Config::multiPage)
         return;
 
-    // Add progress to status bar
-    emit progressSig("Despeckle...", selection.count());
-
-    // Blank each page in turn
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        Page page = item->data(Qt::UserRole).value<Page>();
-        QImage mask = page.despeckle(Config::despeckleArea, false, &blobs);
-        if (blobs > 0)
-        {
-            page.push();
-            page.applyMask(mask, Config::bgColor);
-            item->setData(Qt::UserRole, QVariant::fromValue(page));
-            item->setIcon(makeIcon(page.m_img, page.modified()));
-        }
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(false);
+    int area = Config::despeckleArea;
+    QColor bg = Config::bgColor;
+    runBatch("Despeckle...", selection, [area, bg](Page &page) {
+        return Batch::despeckle(page, area, bg);
+    }, false);
 }
 
 //
@@ -547,8 +605,6 @@ void Bookmarks::despeckle()
 //
 void Bookmarks::devoid()
 {
-    int blobs;
-
     // Get list of all selected items
     QList<QListWidgetItem*> selection = selectedItems();
     if (selection.count() == 0)
@@ -559,32 +615,11 @@ void Bookmarks::devoid()
     if (!Config::multiPage)
         return;
 
-    // Add progress to status bar
-    emit progressSig("Devoid...", selection.count());
-
-    // Blank each page in turn
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        Page page = item->data(Qt::UserRole).value<Page>();
-        QImage mask = page.despeckle(Config::devoidArea, true, &blobs);
-        if (blobs > 0)
-        {
-            page.push();
-            page.applyMask(mask, Config::fgColor);
-            item->setData(Qt::UserRole, QVariant::fromValue(page));
-            item->setIcon(makeIcon(page.m_img, page.modified()));
-        }
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(false);
+    int area = Config::devoidArea;
+    QColor fg = Config::fgColor;
+    runBatch("Devoid...", selection, [area, fg](Page &page) {
+        return Batch::devoid(page, area, fg);
+    }, false);
 }
 
 //
@@ -602,31 +637,7 @@ void Bookmarks::deskew()
     if (!Config::multiPage)
         return;
 
-    // Add progress to status bar
-    emit progressSig("Deskew...", selection.count());
-
-    // Blank each page in turn
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        Page page = item->data(Qt::UserRole).value<Page>();
-        float angle = page.calcDeskew();
-        QImage img = page.deskew(angle);
-        page.push();
-        page.applyDeskew(img);
-
-        item->setData(Qt::UserRole, QVariant::fromValue(page));
-        item->setIcon(makeIcon(page.m_img, page.modified()));
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(false);
+    runBatch("Deskew...", selection, Batch::deskew, false);
 }
 
 //
@@ -644,28 +655,7 @@ void Bookmarks::toGrayscale()
     if (!Config::multiPage)
         return;
 
-    // Add progress to status bar
-    emit progressSig("Grayscale...", selection.count());
-
-    // Blank each page in turn
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        Page page = item->data(Qt::UserRole).value<Page>();
-        page.push();
-        page.toGrayscale();
-        item->setData(Qt::UserRole, QVariant::fromValue(page));
-        item->setIcon(makeIcon(page.m_img, page.modified()));
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(false);
+    runBatch("Grayscale...", selection, Batch::toGrayscale, false);
 }
 
 //
@@ -683,33 +673,10 @@ void Bookmarks::toBinary()
     if (!Config::multiPage)
         return;
 
-    // Add progress to status bar
-    emit progressSig("Binary...", selection.count());
-
-    // Blank each page in turn
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        Page page = item->data(Qt::UserRole).value<Page>();
-
-        // If last operation converted to mono, undo it
-        if ((page.m_img.format() == QImage::Format_Mono) && (page.peek().format() != QImage::Format_Mono))
-            page.undo();
-
-        page.push();
-        page.toBinary(false, Config::blurRadius);
-        item->setData(Qt::UserRole, QVariant::fromValue(page));
-        item->setIcon(makeIcon(page.m_img, page.modified()));
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(false);
+    int blur = Config::blurRadius;
+    runBatch("Binary...", selection, [blur](Page &page) {
+        return Batch::toBinary(page, false, blur);
+    }, false);
 }
 
 //
@@ -727,33 +694,11 @@ void Bookmarks::toAdaptive()
     if (!Config::multiPage)
         return;
 
-    // Add progress to status bar
-    emit progressSig("Adaptive...", selection.count());
-
-    // Blank each page in turn
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        Page page = item->data(Qt::UserRole).value<Page>();
-
-        // If last operation converted to mono, undo it
-        if ((page.m_img.format() == QImage::Format_Mono) && (page.peek().format() != QImage::Format_Mono))
-            page.undo();
-
-        page.push();
-        page.toBinary(true, Config::adaptiveBlurRadius, Config::kernelSize);
-        item->setData(Qt::UserRole, QVariant::fromValue(page));
-        item->setIcon(makeIcon(page.m_img, page.modified()));
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(false);
+    int blur = Config::adaptiveBlurRadius;
+    int kernel = Config::kernelSize;
+    runBatch("Adaptive...", selection, [blur, kernel](Page &page) {
+        return Batch::toBinary(page, true, blur, kernel);
+    }, false);
 }
 
 //
@@ -771,33 +716,7 @@ void Bookmarks::toDithered()
     if (!Config::multiPage)
         return;
 
-    // Add progress to status bar
-    emit progressSig("Dithering...", selection.count());
-
-    // Blank each page in turn
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        Page page = item->data(Qt::UserRole).value<Page>();
-
-        // If last operation converted to mono, undo it
-        if ((page.m_img.format() == QImage::Format_Mono) && (page.peek().format() != QImage::Format_Mono))
-            page.undo();
-
-        page.push();
-        page.toDithered();
-        item->setData(Qt::UserRole, QVariant::fromValue(page));
-        item->setIcon(makeIcon(page.m_img, page.modified()));
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(false);
+    runBatch("Dithering...", selection, Batch::toDithered, false);
 }
 
 //
@@ -819,34 +738,10 @@ void Bookmarks::centerPage()
         selection.append(last);
     }
 
-    // Add progress to status bar
-    emit progressSig("Centering...", selection.count());
-
-    // Center each page in turn
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        // Get page
-        Page page = item->data(Qt::UserRole).value<Page>();
-
-        // Work
-        page.push();
-        page.doCenter(Config::bgColor);
-
-        // Update list with new image
-        item->setData(Qt::UserRole, QVariant::fromValue(page));
-        item->setIcon(makeIcon(page.m_img, page.modified()));
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(false);
+    QColor bg = Config::bgColor;
+    runBatch("Centering...", selection, [bg](Page &page) {
+        return Batch::center(page, bg);
+    }, false);
 }
 
 //
@@ -857,8 +752,6 @@ void Bookmarks::centerPage()
 //
 void Bookmarks::rotateSelection(int rot)
 {
-    QTransform tmat = QTransform().rotate(rot * 90.0);
-
     // Get list of all selected items
     QList<QListWidgetItem*> selection = selectedItems();
     if (selection.count() == 0)
@@ -867,36 +760,9 @@ void Bookmarks::rotateSelection(int rot)
         return;
     }
 
-    // Add progress to status bar
-    emit progressSig("Rotating...", selection.count());
-
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        Page page = item->data(Qt::UserRole).value<Page>();
-        page.push();
-        QImage img = page.m_img;
-
-        // Rotate image based on transform
-        img = img.transformed(tmat, Qt::SmoothTransformation);
-
-        // Update list with new image
-        page.m_img = img;
-        if (rot != 2)
-            page.scaleFactor = 0.0; // Assume the pages dimensions have changed
-        item->setData(Qt::UserRole, QVariant::fromValue(page));
-        item->setIcon(makeIcon(page.m_img, page.modified()));
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(true);
+    runBatch("Rotating...", selection, [rot](Page &page) {
+        return Batch::rotate(page, rot);
+    }, true);
 }
 
 //
@@ -939,34 +805,9 @@ void Bookmarks::mirrorSelection(int dir)
         return;
     }
 
-    // Add progress to status bar
-    emit progressSig("Rotating...", selection.count());
-
-    int progress = 1;
-    foreach(QListWidgetItem* item, selection)
-    {
-        Page page = item->data(Qt::UserRole).value<Page>();
-        page.push();
-        QImage img = page.m_img;
-
-        // Mirror image
-        img = img.mirrored(((dir & 1) == 1), ((dir & 2) == 2));
-
-        // Update list with new image
-        page.m_img = img;
-        item->setData(Qt::UserRole, QVariant::fromValue(page));
-        item->setIcon(makeIcon(page.m_img, page.modified()));
-
-        // Update progress
-        emit progressSig("", progress);
-        progress = progress + 1;
-    }
-
-    // Cleanup status bar
-    emit progressSig("", -1);
-
-    // Update Viewer
-    emit updatePageSig(false);
+    runBatch("Rotating...", selection, [dir](Page &page) {
+        return Batch::mirror(page, dir);
+    }, false);
 }
 
 //
@@ -987,74 +828,127 @@ void Bookmarks::mirrorVert()
 
 //
 // Make a new icon after editing in Viewer
+//     Only the part of the icon covering dirty is redrawn
 //
-void Bookmarks::updateIcon()
+void Bookmarks::updateIcon(QRect dirty)
 {
     // Get active item
     QList<QListWidgetItem*> items = selectedItems();
     QListWidgetItem* item = items.last();
-    Page page = item->data(Qt::UserRole).value<Page>();
-    item->setIcon(makeIcon(page.m_img, page.modified()));
+    Page &page = PageItem::pageOf(item);
+    thumbs.request(item, page.m_img, page.modified(), dirty);
+
+    // Edits grow the undo history
+    trimCache();
 }
 
 //
-// Make an icon from the image and add a marker if it has changed
+// Run an operation on every page of the selection using all cores
+//     Pages are copied out of the list, processed in parallel and
+//     committed back in order once all of them have finished. The
+//     operation returns false if it left the page untouched. Pages
+//     that were evicted go back to scratch files once processed so
+//     large selections stay within the memory budget.
 //
-QIcon Bookmarks::makeIcon(QImage &image, bool flag)
+bool Bookmarks::runBatch(QString descr, QList<QListWidgetItem*> selection, std::function<bool(Page &)> op, bool updateZoom)
 {
-    // Fill background
-    QImage qimg(100, 100, QImage::Format_RGB32);
-    qimg.fill(QColor(240, 240, 240));
-
-    // Draw image
-    QPainter painter(&qimg);
-    QImage scaledImage = image.scaled(100, 100, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    if (scaledImage.width() > scaledImage.height())
-    {
-        float m = (100 - scaledImage.height()) / 2.0;
-        painter.drawImage(QPoint(0,m), scaledImage);
-    } else {
-        float m = (100 - scaledImage.width()) / 2.0;
-        painter.drawImage(QPoint(m,0), scaledImage);
-    }
+    // Only one batch at a time, and not while reading files
+    if (batchWatcher.isRunning() || !loadNames.isEmpty())
+        return false;
+
+    // Pick up edits still pending in the Viewer
+    emit syncPageSig();
 
-    // Mark if changed
-    if (flag)
+    // Snapshot the pages
+    batchItems = selection;
+    batchJobs.clear();
+    batchJobs.reserve(selection.count());
+    foreach(QListWidgetItem* item, selection)
     {
-        QPainterPath path = QPainterPath();
-        path.addRect(QRectF(2,2,10,10));
-        painter.fillPath(path, Qt::red);
-        painter.drawPath(path);
+        BatchJob job;
+        job.page = PageItem::pageOf(item);
+        if (!job.page.loaded() && job.page.m_spillFile.isEmpty())
+            job.page.m_spillFile = cache.spillPath();
+        batchJobs.append(job);
     }
+    batchZoom = updateZoom;
+
+    // Add progress to status bar and lock out edits until done
+    emit progressSig(descr, selection.count());
+    emit busySig(true);
+
+    // Fan the pages out across the thread pool
+    batchWatcher.setFuture(QtConcurrent::map(batchJobs, [op](BatchJob &job) {
+        bool evicted = !job.page.loaded();
+        if (job.page.load())
+            job.changed = op(job.page);
+
+        // Evicted pages leave memory here, so draw their icon while it is at hand
+        if (job.changed && evicted)
+        {
+            job.icon = ThumbService::iconImage(job.page.m_img, job.page.modified());
+            job.page.spill();
+        }
+    }));
+    return true;
+}
 
-    // Display format
-    QString txt = "";
-    switch (image.format())
+//
+// Commit results of the batch back into the list
+//
+void Bookmarks::batchFinished()
+{
+    for(int idx=0; idx<batchItems.count(); idx++)
     {
-        case QImage::Format_RGB888:
-        case QImage::Format_RGB32:
-        case QImage::Format_ARGB32:
-            txt = "RGB";
-            break;
-        case QImage::Format_Grayscale8:
-            txt = "GS";
-            break;
-        case QImage::Format_Mono:
-            txt = "BW";
-            break;
-        default:
-            txt = "???";
-            break;
+        BatchJob &job = batchJobs[idx];
+        if (!job.changed)
+            continue;
+        QListWidgetItem* item = batchItems.at(idx);
+        PageItem::pageOf(item) = job.page;
+        if (job.icon.isNull())
+            thumbs.request(item, job.page.m_img, job.page.modified());
+        else
+        {
+            // Drop any older icon still being drawn
+            thumbs.remove(item);
+            static_cast<PageItem*>(item)->setIconImage(job.icon);
+        }
+        if (job.page.loaded())
+            cache.touch(item);
     }
-    painter.setPen(Qt::black);
-    painter.setFont(QFont("Courier", 8));
-    painter.drawText(QRect(0,0,100,100), Qt::AlignRight|Qt::AlignBottom, txt);
+    batchItems.clear();
+    batchJobs.clear();
+    trimCache();
 
-    painter.end();
+    // Cleanup status bar
+    emit progressSig("", -1);
+    emit busySig(false);
+
+    // Update Viewer
+    emit updatePageSig(batchZoom);
+}
+
+//
+// Evict pages over the memory budget, except the one in the Viewer
+//
+void Bookmarks::trimCache()
+{
+    // Batches hold copies of the pages, wait until they commit
+    if (batchWatcher.isRunning())
+        return;
 
-    // Convert to icon
-    QIcon icon = QIcon(QPixmap::fromImage(qimg));
-    return icon;
+    QList<QListWidgetItem*> items = selectedItems();
+    cache.trim(items.isEmpty() ? nullptr : items.last());
+}
+
+//
+// Delete an item along with its scratch file
+//
+void Bookmarks::removeItem(QListWidgetItem *item)
+{
+    cache.remove(item);
+    thumbs.remove(item);
+    delete item;
 }
 
 //
@@ -1063,18 +957,21 @@ QIcon Bookmarks::makeIcon(QImage &image, bool flag)
 //
 void Bookmarks::undoEdit()
 {
+    emit syncPageSig();
     QList<QListWidgetItem*> items = selectedItems();
     if (items.count() == 0)
         return;
 
     // Get active item
     QListWidgetItem* item = items.last();
-    Page page = item->data(Qt::UserRole).value<Page>();
+    Page &page = PageItem::pageOf(item);
+    if (!page.loaded())
+        return;
 
     // Revert last edit
     bool flag = page.undo();
-    item->setData(Qt::UserRole, QVariant::fromValue(page));
-    item->setIcon(makeIcon(page.m_img, page.modified()));
+    QRect dirty = page.takeIconDirty();
+    thumbs.request(item, page.m_img, page.modified(), dirty);
 
     // Update Viewer
     emit updatePageSig(flag);
@@ -1086,18 +983,21 @@ void Bookmarks::undoEdit()
 //
 void Bookmarks::redoEdit()
 {
+    emit syncPageSig();
     QList<QListWidgetItem*> items = selectedItems();
     if (items.count() == 0)
         return;
 
     // Get active item
     QListWidgetItem* item = items.last();
-    Page page = item->data(Qt::UserRole).value<Page>();
+    Page &page = PageItem::pageOf(item);
+    if (!page.loaded())
+        return;
 
     // Revert last edit
     bool flag = page.redo();
-    item->setData(Qt::UserRole, QVariant::fromValue(page));
-    item->setIcon(makeIcon(page.m_img, page.modified()));
+    QRect dirty = page.takeIconDirty();
+    thumbs.request(item, page.m_img, page.modified(), dirty);
 
     // Update Viewer
     emit updatePageSig(flag);
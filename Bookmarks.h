@@ -2,10 +2,19 @@
 #define BOOKMARKS_H
 
 #include "Page.h"
+#include "PageCache.h"
+#include "PageItem.h"
+#include "ThumbService.h"
 #include <QEnterEvent>
+#include <QFutureWatcher>
 #include <QImage>
 #include <QListWidget>
+#include <QMap>
 #include <QWidget>
+#include <functional>
+
+// Limit on decoded pages waiting to be inserted during file reads
+#define MAX_LOAD_BYTES (1024LL * 1024 * 1024)
 
 class Bookmarks : public QListWidget
 {
@@ -42,7 +51,7 @@ public slots:
     void rotate180();
     void mirrorHoriz();
     void mirrorVert();
-    void updateIcon();
+    void updateIcon(QRect dirty);
     void undoEdit();
     void redoEdit();
 
@@ -50,13 +59,59 @@ signals:
     void changePageSig(QListWidgetItem* curr);
     void updatePageSig(bool updateZoom);
     void progressSig(QString descr, int val);
+    void busySig(bool busy);
+    void syncPageSig();
 
 private:
+    // Work item for the batch engine
+    struct BatchJob
+    {
+        Page page;
+        QImage icon;
+        bool changed = false;
+    };
+
+    // Result of reading one file
+    struct LoadJob
+    {
+        Page page;
+        QImage icon;
+        qint64 bytes = 0;
+    };
+
     void readFiles(QString cmd);
+    static LoadJob loadPage(QString fileName, bool lazy);
+    void loadStart();
+    void insertLoaded();
     bool saveCommon(QListWidgetItem* itemPtr, QString &fileName, QString &backupName);
     void rotateSelection(int val);
     void mirrorSelection(int dir);
-    QIcon makeIcon(QImage &image, bool flag);
+    bool runBatch(QString descr, QList<QListWidgetItem*> selection, std::function<bool(Page &)> op, bool updateZoom);
+    void batchFinished();
+    void trimCache();
+    void removeItem(QListWidgetItem *item);
+
+    QFutureWatcher<void> batchWatcher;
+    QList<QListWidgetItem*> batchItems;
+    QVector<BatchJob> batchJobs;
+    bool batchZoom = false;
+
+    QString loadCmd;
+    QStringList loadNames;
+    QStringList loadErrors;
+    QVector<int> loadRows;
+    QMap<int, LoadJob> loadDone;
+    bool loadLazy = false;
+    int loadFirstIdx = 0;
+    int loadNext = 0;
+    int loadInsert = 0;
+    qint64 loadBytes = 0;
+
+    // Keeps pages in memory within Config::memoryBudget
+    PageCache cache;
+
+    // Redraws icons after edits without holding up the GUI
+    ThumbService thumbs;
 
 protected:
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
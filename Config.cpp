@@ -20,6 +20,9 @@ namespace Config
     QFont textFont;
     QPointF locate1;
     QPointF locate2;
+    bool lazyLoad;
+    int memoryBudget;
+    int undoBudget;
 
     QColor fgColor;
     QColor bgColor;
@@ -60,6 +63,9 @@ namespace Config
         locate1 = QPointF(val1.split(",")[0].toFloat(),val1.split(",")[1].toFloat());
         QString val2 = settings.value("locate2", "0,0").toString();
         locate2 = QPointF(val2.split(",")[0].toFloat(),val2.split(",")[1].toFloat());
+        lazyLoad = settings.value("lazyLoad", false).toBool();
+        memoryBudget = settings.value("memoryBudget", 2048).toInt();
+        undoBudget = settings.value("undoBudget", 256).toInt();
 
         // Not loaded or saved
         deskewAngle = 0.0;
@@ -85,5 +91,8 @@ namespace Config
         settings.setValue("font", textFont.toString());
         settings.setValue("locate1", QStringLiteral("%1,%2").arg(locate1.x()).arg(locate1.y()));
         settings.setValue("locate2", QStringLiteral("%1,%2").arg(locate2.x()).arg(locate2.y()));
+        settings.setValue("lazyLoad", lazyLoad);
+        settings.setValue("memoryBudget", memoryBudget);
+        settings.setValue("undoBudget", undoBudget);
     }
 }
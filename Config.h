@@ -24,6 +24,9 @@ namespace Config
     extern QFont textFont;
     extern QPointF locate1;
     extern QPointF locate2;
+    extern bool lazyLoad;
+    extern int memoryBudget;
+    extern int undoBudget;
 
     extern QColor fgColor;
     extern QColor bgColor;
@@ -1,34 +1,203 @@
 // Page.cpp
 
 #include "Page.h"
+#include "Config.h"
+#include "Utils/ColorKernels.h"
+#include "Utils/ImagePack.h"
+#include "Utils/MonoKernels.h"
 #include "Utils/QImage2OCV.h"
-#include <QApplication>
+#include <QDataStream>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
 #include <QPainter>
 #include <QtConcurrent/QtConcurrent>
-#include <leptonica/allheaders.h>
+#include <QtEndian>
+#include <climits>
 #include <math.h>
 
+// Blob labels of both polarities, for the image with the given cacheKey
+struct Page::BlobCache
+{
+    QMutex mutex;
+    qint64 key[2] = { -1, -1 };
+    MonoBlobs blobs[2];
+};
+
 // Constuctors
 Page::Page()
 {
     m_img = QImage();
+    m_blobCache.reset(new BlobCache);
 }
 
 Page::Page(const QString &fileName, const char *format)
 {
     m_img = QImage(fileName, format);
+    m_fileName = fileName;
+    m_blobCache.reset(new BlobCache);
 }
 
 Page::Page(const QImage &image)
 {
     m_img = image;
+    m_blobCache.reset(new BlobCache);
 }
 
 Page::~Page()
 {
 }
 
+//
+// Check if the image is in memory
+//     Pages imported lazily only have a file name until first use
+//
+bool Page::loaded()
+{
+    return !m_img.isNull() || (m_fileName.isEmpty() && m_spillFile.isEmpty());
+}
+
+//
+// Read the image if it hasn't been already
+//
+bool Page::load()
+{
+    if (loaded())
+        return !m_img.isNull();
+    if (!m_spillFile.isEmpty())
+        return unspill();
+    m_img = QImage(m_fileName);
+    normalize();
+    return !m_img.isNull();
+}
+
+//
+// Release the image if it can be read back from its file
+//
+bool Page::unload()
+{
+    if (m_fileName.isEmpty() || modified() || !m_undo.isEmpty() || !m_redo.isEmpty())
+        return false;
+    if (!m_spillFile.isEmpty())
+        QFile(m_spillFile).remove();
+    m_spillFile.clear();
+    m_img = QImage();
+    m_blobCache.reset(new BlobCache);
+    return true;
+}
+
+//
+// Write image and undo history to the scratch file and release them
+//
+bool Page::spill()
+{
+    if (m_spillFile.isEmpty())
+        return false;
+    QFile file(m_spillFile);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out << packImage(m_img);
+    out << (qint32)m_undo.count();
+    foreach(const UndoStep &step, m_undo)
+        out << step.img.packed() << step.rect << step.full << (qint32)step.format;
+    out << (qint32)m_redo.count();
+    foreach(const UndoStep &step, m_redo)
+        out << step.img.packed() << step.rect << step.full << (qint32)step.format;
+    file.close();
+    if ((out.status() != QDataStream::Ok) || (file.error() != QFileDevice::NoError))
+        return false;
+
+    m_img = QImage();
+    m_undo.clear();
+    m_redo.clear();
+    m_blobCache.reset(new BlobCache);
+    return true;
+}
+
+//
+// Read back what spill() wrote
+//     The file is kept so that a later spill can reuse it
+//
+bool Page::unspill()
+{
+    QFile file(m_spillFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    QByteArray data;
+    qint32 count, format;
+    in >> data;
+    m_img = unpackImage(data);
+
+    // History stays compressed
+    UndoStep step;
+    m_undo.clear();
+    in >> count;
+    for(int idx=0; idx<count; idx++)
+    {
+        in >> data >> step.rect >> step.full >> format;
+        step.img = PackedImage::fromPacked(data);
+        step.format = (QImage::Format)format;
+        m_undo.append(step);
+    }
+    m_redo.clear();
+    in >> count;
+    for(int idx=0; idx<count; idx++)
+    {
+        in >> data >> step.rect >> step.full >> format;
+        step.img = PackedImage::fromPacked(data);
+        step.format = (QImage::Format)format;
+        m_redo.append(step);
+    }
+    return !m_img.isNull();
+}
+
+//
+// Bytes held by the image and its undo history
+//
+qint64 Page::memoryUsage()
+{
+    qint64 bytes = m_img.sizeInBytes();
+    foreach(const UndoStep &step, m_undo)
+        bytes += step.img.sizeInBytes();
+    foreach(const UndoStep &step, m_redo)
+        bytes += step.img.sizeInBytes();
+    QMutexLocker lock(&m_blobCache->mutex);
+    for(const MonoBlobs &found : m_blobCache->blobs)
+        bytes += found.runs.size() * sizeof(MonoRun) + found.count() * (sizeof(int) + sizeof(QRect));
+    return bytes;
+}
+
+//
+// Convert freshly loaded image to a format that can be edited
+//
+void Page::normalize()
+{
+    // Cannot paint on indexed8, so convert to better format
+    if (m_img.format() == QImage::Format_Indexed8)
+    {
+        if (m_img.allGray())
+            m_img = m_img.convertToFormat(QImage::Format_Grayscale8);
+        else
+            m_img = m_img.convertToFormat(QImage::Format_RGB32);
+    }
+
+    // If image has 2 colors, but they aren't black and white, promote to RGB
+    if ((m_img.format() == QImage::Format_Mono) && (m_img.colorCount() == 2))
+    {
+        if ((m_img.color(0) == 0xFFFFFFFF) && (m_img.color(1) == 0xFF000000))
+            ;
+        else if ((m_img.color(0) == 0xFF000000) && (m_img.color(1) == 0xFFFFFFFF))
+            ;
+        else
+            m_img = m_img.convertToFormat(QImage::Format_RGB32);
+    }
+}
+
 //
 // Indicates if page was changed since loading or last save
 //
@@ -49,16 +218,140 @@ void Page::flush()
     m_modified = 0;
 }
 
+//
+// Widen rect to whole bytes so it can be copied a scanline at a time
+//
+static QRect alignRect(const QImage &img, QRect rect)
+{
+    rect = rect & img.rect();
+    if (rect.isEmpty() || (img.depth() >= 8))
+        return rect;
+    int left = rect.left() & ~7;
+    int right = std::min(rect.right() | 7, img.width() - 1);
+    return QRect(QPoint(left, rect.top()), QPoint(right, rect.bottom()));
+}
+
+//
+// Copy src into dst at an aligned rect, formats must match
+//
+static void pasteRect(QImage &dst, const QRect &rect, const QImage &src)
+{
+    int offset = rect.left() * dst.depth() / 8;
+    int bytes = (rect.width() * dst.depth() + 7) / 8;
+    for(int y=0; y<rect.height(); y++)
+        memcpy(dst.scanLine(rect.top() + y) + offset, src.constScanLine(y), bytes);
+}
+
 //
 // Save current image to undo buffer
+//     Use for edits that change the size or format
 //
 void Page::push()
 {
-    m_undo.insert(0, m_img);
-    if (m_undo.count() >  MAX_UNDO)
-        m_undo.removeLast();
+    UndoStep step;
+    step.img = PackedImage(m_img);
+    step.format = m_img.format();
+    m_dirty = QRect(0, 0, INT_MAX, INT_MAX);
+    m_iconDirty = m_dirty;
+    m_undo.insert(0, step);
     m_redo.clear();
     m_modified++;
+    m_blobCache.reset(new BlobCache);
+    trimHistory();
+}
+
+//
+// Save only the pixels under rect before an edit in place
+//
+void Page::push(QRect rect)
+{
+    UndoStep step;
+    step.full = false;
+    step.rect = alignRect(m_img, rect);
+    step.format = m_img.format();
+    if (!step.rect.isEmpty())
+        step.img = PackedImage(m_img.copy(step.rect));
+    m_dirty |= step.rect;
+    m_iconDirty |= step.rect;
+    m_undo.insert(0, step);
+    m_redo.clear();
+    m_modified++;
+    m_blobCache.reset(new BlobCache);
+    trimHistory();
+}
+
+//
+// Grow the last undo step to cover rect before drawing into it
+//     Pencil strokes call this for every segment
+//
+void Page::extend(QRect rect)
+{
+    if (m_undo.isEmpty() || m_undo.first().full)
+        return;
+    UndoStep &step = m_undo.first();
+    QRect area = rect & m_img.rect();
+    m_dirty |= area;
+    m_iconDirty |= area;
+    if (step.rect.contains(area))
+        return;
+
+    // Add some slack so a stroke doesn't regrow on every segment
+    QRect grown = alignRect(m_img, step.rect | rect.adjusted(-32, -32, 32, 32));
+    QImage img = m_img.copy(grown);
+    if (!step.rect.isEmpty())
+        pasteRect(img, step.rect.translated(-grown.topLeft()), step.img.image());
+    step.img = PackedImage(img);
+    step.rect = grown;
+}
+
+//
+// Keep the history within Config::undoBudget
+//     The newest step stays uncompressed so undo is quick, older ones
+//     are compressed in the background and the oldest dropped once the
+//     budget is used up
+//
+void Page::trimHistory()
+{
+    qint64 budget = (qint64)Config::undoBudget * 1024 * 1024;
+    qint64 total = 0;
+    for(int idx=0; idx<m_undo.count(); idx++)
+    {
+        total += m_undo.at(idx).img.sizeInBytes();
+        if ((idx > 0) && (total > budget))
+        {
+            m_undo.erase(m_undo.begin() + idx, m_undo.end());
+            break;
+        }
+        if (idx > 0)
+            m_undo[idx].img.compress();
+    }
+    for(int idx=1; idx<m_redo.count(); idx++)
+        m_redo[idx].img.compress();
+}
+
+//
+// Apply an undo/redo step and return the step that reverses it
+//
+Page::UndoStep Page::swapStep(const UndoStep &step)
+{
+    UndoStep prev = step;
+    prev.format = m_img.format();
+    if (step.full)
+    {
+        prev.img = PackedImage(m_img);
+        m_img = step.img.image();
+        m_dirty = QRect(0, 0, INT_MAX, INT_MAX);
+        m_iconDirty = m_dirty;
+    }
+    else if (!step.rect.isEmpty())
+    {
+        prev.img = PackedImage(m_img.copy(step.rect));
+        pasteRect(m_img, step.rect, step.img.image());
+        m_dirty |= step.rect;
+        m_iconDirty |= step.rect;
+    }
+    m_blobCache.reset(new BlobCache);
+    return prev;
 }
 
 //
@@ -69,9 +362,9 @@ bool Page::undo()
     QSize oldSize = m_img.size();
     if (m_undo.count() > 0)
     {
-        m_redo.insert(0, m_img);
-        m_img = m_undo.takeFirst();
+        m_redo.insert(0, swapStep(m_undo.takeFirst()));
         m_modified--;
+        trimHistory();
     }
     return (m_img.size() != oldSize);
 }
@@ -84,21 +377,73 @@ bool Page::redo()
     QSize oldSize = m_img.size();
     if (m_redo.count() > 0)
     {
-        m_undo.insert(0, m_img);
-        m_img = m_redo.takeFirst();
+        m_undo.insert(0, swapStep(m_redo.takeFirst()));
         m_modified++;
+        trimHistory();
     }
     return (m_img.size() != oldSize);
 }
 
 //
-// Peek at last image
+// Format of the image before the last edit
 //
-QImage Page::peek()
+QImage::Format Page::peekFormat()
 {
     if (m_undo.count() > 0)
-        return m_undo.first();
-    return QImage();
+        return m_undo.first().format;
+    return m_img.format();
+}
+
+//
+// Get and clear the area changed since the last call
+//     Used by the Viewer to refresh its tiles. Empty when nothing
+//     changed, the whole page when the image was replaced without an
+//     edit rect.
+//
+QRect Page::takeDirty()
+{
+    QRect dirty = m_dirty;
+    if (dirty.isEmpty() && (m_img.cacheKey() != m_dirtyKey))
+        dirty = QRect(0, 0, INT_MAX, INT_MAX);
+    m_dirty = QRect();
+    m_dirtyKey = m_img.cacheKey();
+    return dirty;
+}
+
+//
+// Get and clear the area changed since the icon was last refreshed
+//
+QRect Page::takeIconDirty()
+{
+    QRect dirty = m_iconDirty;
+    m_iconDirty = QRect();
+    return dirty;
+}
+
+//
+// Bounding box of the selected pixels in a mask
+//
+QRect Page::maskRect(const QImage &mask)
+{
+    int top = mask.height(), bottom = -1;
+    int left = mask.width(), right = -1;
+    for(int y=0; y<mask.height(); y++)
+    {
+        const uchar *ptr = mask.constScanLine(y);
+        const uchar *first = (const uchar *)memchr(ptr, 0, mask.width());
+        if (first == nullptr)
+            continue;
+        int last = mask.width() - 1;
+        while (ptr[last] != 0)
+            last--;
+        top = std::min(top, y);
+        bottom = y;
+        left = std::min(left, int(first - ptr));
+        right = std::max(right, last);
+    }
+    if (bottom < 0)
+        return QRect();
+    return QRect(QPoint(left, top), QPoint(right, bottom));
 }
 
 //
@@ -114,54 +459,80 @@ QImage Page::colorSelect(QRgb target, int threshold)
     // Find targets within threshold of target
     if ((m_img.format() == QImage::Format_RGB32) || (m_img.format() == QImage::Format_ARGB32))
     {
-        int red = qRed(target);
-        int grn = qGreen(target);
-        int blu = qBlue(target);
-
-        // Scan through page seeking matches
         for(int i=0; i<m_img.height(); i++)
-        {
-            QRgb *srcPtr = (QRgb *)m_img.scanLine(i);
-            uchar *maskPtr = reinterpret_cast<uchar*>(mask.scanLine(i));
-            for(int j=0; j<m_img.width(); j++)
-            {
-                QRgb val = *srcPtr++;
-                int max = abs(red - qRed(val));
-                int tmp = abs(grn - qGreen(val));
-                if (tmp > max)
-                    max = tmp;
-                tmp = abs(blu - qBlue(val));
-                if (tmp > max)
-                    max = tmp;
-                if (max > threshold)
-                    *maskPtr++ = 1;
-                else
-                    *maskPtr++ = 0;
-            }
-        }
+            selectRGB32((const QRgb *)m_img.constScanLine(i), mask.scanLine(i), m_img.width(), target, threshold);
     }
     else if (m_img.format() == QImage::Format_Grayscale8)
     {
-        int pix = qRed(target);
+        for(int i=0; i<m_img.height(); i++)
+            selectGray8(m_img.constScanLine(i), mask.scanLine(i), m_img.width(), qRed(target), threshold);
+    }
+    else if ((m_img.format() == QImage::Format_Mono) && (m_img.colorCount() == 2))
+    {
+        // Select against both table colors, then spread the answers over the bits
+        QRgb colors[2] = { m_img.color(0), m_img.color(1) };
+        uchar sel[2];
+        selectRGB32(colors, sel, 2, target, threshold);
+        monoExpand(m_img, mask, sel[0], sel[1]);
+    }
+    else
+        return QImage();
+    return mask;
+}
 
-        // Scan through page seeking matches
+//
+// Distance of every pixel from the target color
+//     Same measure as colorSelect, so thresholdMask on the result gives
+//     the same mask. Lets threshold changes skip the color math.
+//
+QImage Page::distanceMap(QRgb target)
+{
+    QImage dist(m_img.size(), QImage::Format_Grayscale8);
+    if ((m_img.format() == QImage::Format_RGB32) || (m_img.format() == QImage::Format_ARGB32))
+    {
         for(int i=0; i<m_img.height(); i++)
-        {
-            uchar *srcPtr = m_img.scanLine(i);
-            uchar *maskPtr = reinterpret_cast<uchar*>(mask.scanLine(i));
-            for(int j=0; j<m_img.width(); j++)
-            {
-                int val = *srcPtr++;
-                int max = abs(pix - val);
-                if (max > threshold)
-                    *maskPtr++ = 1;
-                else
-                    *maskPtr++ = 0;
-            }
-        }
+            distanceRGB32((const QRgb *)m_img.constScanLine(i), dist.scanLine(i), m_img.width(), target);
+    }
+    else if (m_img.format() == QImage::Format_Grayscale8)
+    {
+        for(int i=0; i<m_img.height(); i++)
+            distanceGray8(m_img.constScanLine(i), dist.scanLine(i), m_img.width(), qRed(target));
+    }
+    else if ((m_img.format() == QImage::Format_Mono) && (m_img.colorCount() == 2))
+    {
+        QRgb colors[2] = { m_img.color(0), m_img.color(1) };
+        uchar val[2];
+        distanceRGB32(colors, val, 2, target);
+        monoExpand(m_img, dist, val[0], val[1]);
     }
     else
         return QImage();
+    return dist;
+}
+
+//
+// Make a selection mask from a distance map
+//
+QImage Page::thresholdMask(const QImage &dist, int threshold)
+{
+    if (dist.isNull())
+        return QImage();
+
+    QImage mask(dist.size(), QImage::Format_Indexed8);
+    mask.setColor( 0, qRgba(0,0,0,0));  // Place holder - replaced in blinker/applyMask
+    mask.setColor( 1, qRgba(0,0,0,0));  // Transparent
+
+    uchar lut[256];
+    for(int idx=0; idx<256; idx++)
+        lut[idx] = (idx > threshold) ? 1 : 0;
+
+    for(int i=0; i<dist.height(); i++)
+    {
+        const uchar *distPtr = dist.constScanLine(i);
+        uchar *maskPtr = mask.scanLine(i);
+        for(int j=0; j<dist.width(); j++)
+            *maskPtr++ = lut[*distPtr++];
+    }
     return mask;
 }
 
@@ -175,122 +546,186 @@ QImage Page::deColor(int threshold)
     mask.setColor( 0, qRgba(0,0,0,0));  // Place holder - replaced in blinker/applyMask
     mask.setColor( 1, qRgba(0,0,0,0));  // Transparent
 
-    // Find targets within threshold of target
+    // Calculate distance between pixel and gray line (0,0,0)->(255,255,255)
+    //
+    // d = norm(cross(p2-p1, p1-p0)) / norm(p2-p1)
+    // where:
+    // p0 = [r,g,b]
+    // p1 = [0,0,0]
+    // p2 = [1,1,1]
+    // and
+    // norm = sqrt(x^2 + y^2 + z^2)
+    // cross(a, b) = [ ay*bz - az*by, az*bx - ax*bz, ax*by - ay*bx ]
+    //
+    // Simplifying:
+    // d = norm(cross(p2, -p0)) / sqrt(3)
+    //
+    // Expanding:
+    // d = norm( [ p2[y] * -p0[z] - p2[z] * -p0[y], p2[z] * -p0[x] - p2[x] * -p0[z], p2[x] * -p0[y] - p2[y] * -p0[x] ] ) / sqrt(3)
+    //
+    // Since all p2 is '1':
+    // d = norm( [ -p0[z] - -p0[y], -p0[x] - -p0[z], -p0[y] - -p0[x] ] ) / sqrt(3)
+    //
+    // Simplify:
+    // d = norm( [ p0[y] - p0[z], p0[z] - p0[x], p0[x] - p0[y] ] ) / sqrt(3)
+    //
+    // Finally:
+    // d = norm( [ g - b, b - r, r - g ] ) / sqrt(3)
+    //
+    // Pixels are colorful when d >= threshold * 2. Squaring both sides
+    // leaves an integer compare of (g-b)^2 + (b-r)^2 + (r-g)^2 against
+    // (threshold * 2 * 1.732)^2, which is worked out once here.
+    //
+    double t = std::max(threshold, 0) * 2 * 1.732;
+    int limit = (int)std::min(ceil(t * t), 1048576.0);
+
+    // Find pixels away from the gray line
     if ((m_img.format() == QImage::Format_RGB32) || (m_img.format() == QImage::Format_ARGB32))
     {
-        int t = threshold * 2;
-        // Scan through page seeking matches
         for(int i=0; i<m_img.height(); i++)
-        {
-            QRgb *srcPtr = (QRgb *)m_img.scanLine(i);
-            uchar *maskPtr = reinterpret_cast<uchar*>(mask.scanLine(i));
-            for(int j=0; j<m_img.width(); j++)
-            {
-                QRgb val = *srcPtr++;
-                int red = qRed(val);
-                int grn = qGreen(val);
-                int blu = qBlue(val);
-                // Calculate distance between pixel and gray line (0,0,0)->(255,255,255)
-                //
-                // d = norm(cross(p2-p1, p1-p0)) / norm(p2-p1)
-                // where:
-                // p0 = [r,g,b]
-                // p1 = [0,0,0]
-                // p2 = [1,1,1]
-                // and
-                // norm = sqrt(x^2 + y^2 + z^2)
-                // cross(a, b) = [ ay*bz - az*by, az*bx - ax*bz, ax*by - ay*bx ]
-                //
-                // Simplifying:
-                // d = norm(cross(p2, -p0)) / sqrt(3)
-                //
-                // Expanding:
-                // d = norm( [ p2[y] * -p0[z] - p2[z] * -p0[y], p2[z] * -p0[x] - p2[x] * -p0[z], p2[x] * -p0[y] - p2[y] * -p0[x] ] ) / sqrt(3)
-                //
-                // Since all p2 is '1':
-                // d = norm( [ -p0[z] - -p0[y], -p0[x] - -p0[z], -p0[y] - -p0[x] ] ) / sqrt(3)
-                //
-                // Simplify:
-                // d = norm( [ p0[y] - p0[z], p0[z] - p0[x], p0[x] - p0[y] ] ) / sqrt(3)
-                //
-                // Finally:
-                // d = norm( [ g - b, b - r, r - g ] ) / sqrt(3)
-                //
-                float d = (grn - blu)*(grn - blu) + (blu - red)*(blu - red) + (red - grn)*(red - grn);
-                d = sqrt(d) / 1.732;
-                if ( d < t )
-                    *maskPtr++ = 1;
-                else
-                    *maskPtr++ = 0;
-                //
-                //if ((red * 2 > grn + blu + t) || (grn * 2 > red + blu + t) || (blu * 2 > red + grn + t))
-                //    *maskPtr++ = 0;
-                //else
-                //    *maskPtr++ = 1;
-            }
-        }
+            deColorRGB32((const QRgb *)m_img.constScanLine(i), mask.scanLine(i), m_img.width(), limit);
     }
+    else if (m_img.format() == QImage::Format_RGB888)
+    {
+        for(int i=0; i<m_img.height(); i++)
+            deColorRGB888(m_img.constScanLine(i), mask.scanLine(i), m_img.width(), limit);
+    }
+    else
+        mask.fill(1);   // Gray and mono pages have no color
     return mask;
 }
 
 //
-// Run this in a separate thread to keep from blocking the UI
+// Convert a label image to runs, which are far smaller to keep
 //
-QImage Page::despeckle(int blobSize, bool invert, int *blobs)
+static MonoBlobs labelRuns(const cv::Mat &labels, const cv::Mat &stats)
 {
-    // Invert for devoid
-    QImage img = m_img;
-    if (invert)
-        img.invertPixels(QImage::InvertRgb);
-
-    // Convert to grayscale
-    if (img.format() != QImage::Format_Grayscale8)
-        img = img.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
-
-    // Convert to OpenCV
-    cv::Mat mat = QImage2OCV(img);
+    MonoBlobs found;
+    for(int idx=1; idx<stats.rows; idx++)
+    {
+        found.area.append(stats.at<int>(idx, cv::CC_STAT_AREA));
+        found.bounds.append(QRect(stats.at<int>(idx, cv::CC_STAT_LEFT), stats.at<int>(idx, cv::CC_STAT_TOP),
+                                  stats.at<int>(idx, cv::CC_STAT_WIDTH), stats.at<int>(idx, cv::CC_STAT_HEIGHT)));
+    }
+    for(int row=0; row<labels.rows; row++)
+    {
+        const int *labelPtr = labels.ptr<int>(row);
+        int col = 0;
+        while (col < labels.cols)
+        {
+            int start = col;
+            int label = labelPtr[col];
+            while ((col < labels.cols) && (labelPtr[col] == label))
+                col++;
+            if (label > 0)
+                found.runs.append({ row, start, col, label - 1 });
+        }
+    }
+    return found;
+}
 
-    // Make B&W with background black
-    cv::Mat bw;
-    cv::threshold(mat, bw, 250, 255, cv::THRESH_BINARY_INV);
+//
+// Blobs of the page, or of its voids when inverted
+//     Kept until the image changes, so a new area limit only has to
+//     rebuild the mask
+//
+MonoBlobs Page::components(bool invert)
+{
+    // The lock is only held to look up and store, labeling runs unlocked
+    QSharedPointer<BlobCache> cache = m_blobCache;
+    int idx = invert ? 1 : 0;
+    {
+        QMutexLocker lock(&cache->mutex);
+        if (cache->key[idx] == m_img.cacheKey())
+            return cache->blobs[idx];
+    }
 
-    // Find blobs
-    cv::Mat stats, centroids, labelImg;
-    int nLabels = cv::connectedComponentsWithStats(bw, labelImg, stats, centroids, 4, CV_32S);
+    MonoBlobs found;
+    if (m_img.format() == QImage::Format_Mono)
+    {
+        // Bilevel pages are labeled straight from the packed bits
+        // Blobs are black pixels, or white ones for devoid
+        int ink = monoInk(m_img);
+        found = monoComponents(m_img, invert ? 1 - ink : ink);
+    }
+    else
+    {
+        // Invert for devoid
+        QImage img = m_img;
+        if (invert)
+            img.invertPixels(QImage::InvertRgb);
+
+        // Convert to grayscale
+        if (img.format() != QImage::Format_Grayscale8)
+            img = img.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
+
+        // View as OpenCV
+        cv::Mat mat = QImage2OCVView(img);
+
+        // Make B&W with background black
+        cv::Mat bw;
+        cv::threshold(mat, bw, 250, 255, cv::THRESH_BINARY_INV);
+
+        // Find blobs
+        cv::Mat stats, centroids, labelImg;
+        cv::connectedComponentsWithStats(bw, labelImg, stats, centroids, 4, CV_32S);
+        found = labelRuns(labelImg, stats);
+    }
+    QMutexLocker lock(&cache->mutex);
+    cache->key[idx] = m_img.cacheKey();
+    cache->blobs[idx] = found;
+    return found;
+}
 
-    // Initialize mask
-    QImage mask(img.size(), QImage::Format_Indexed8);
-    mask.setColor( 0, qRgba(0,0,0,0));  // Place holder - replaced in blinker/applyMask
-    mask.setColor( 1, qRgba(0,0,0,0));  // Transparent
-    mask.fill(1);
+//
+// Run this in a separate thread to keep from blocking the UI
+//
+QImage Page::despeckle(int blobSize, bool invert, int *blobs)
+{
+    MonoBlobs found = components(invert);
 
-    // Build mask of blobs smaller than limit
+    // Mask value for each label, 0 for blobs smaller than limit
+    QVector<uchar> lut(found.count(), 1);
     int cnt = 0;
-    for(int idx=1; idx<nLabels; idx++)
+    for(int idx=0; idx<found.count(); idx++)
     {
-        // Check if this blob is small enough
-        if (stats.at<int>(idx, cv::CC_STAT_AREA) <= blobSize)
+        if (found.area[idx] <= blobSize)
         {
-            int top = stats.at<int>(idx, cv::CC_STAT_TOP);
-            int bot = stats.at<int>(idx, cv::CC_STAT_TOP) + stats.at<int>(idx, cv::CC_STAT_HEIGHT);
-            int left = stats.at<int>(idx, cv::CC_STAT_LEFT);
-            int right = stats.at<int>(idx, cv::CC_STAT_LEFT) + stats.at<int>(idx, cv::CC_STAT_WIDTH);
-
-            // Sweep the enclosing rectangle, setting pixels in the mask
-            for (int row=top; row<bot; row++)
-            {
-                uchar *maskPtr = reinterpret_cast<uchar*>(mask.scanLine(row));
-                for (int col=left; col<right; col++)
-                {
-                    if (labelImg.at<int>(row,col) == idx)
-                        maskPtr[col] = 0;
-                }
-            }
+            lut[idx] = 0;
             cnt++;
         }
     }
     if (blobs != nullptr)
         *blobs = cnt;
+
+    // Initialize mask
+    QImage mask(m_img.size(), QImage::Format_Indexed8);
+    mask.setColor( 0, qRgba(0,0,0,0));  // Place holder - replaced in blinker/applyMask
+    mask.setColor( 1, qRgba(0,0,0,0));  // Transparent
+
+    // Pointers are taken up front, scanLine isn't safe to call from several threads
+    uchar *bits = mask.bits();
+    size_t bpl = mask.bytesPerLine();
+    const uchar *table = lut.constData();
+
+    // Fill chunks of rows in parallel, clearing the runs of small blobs
+    QVector<int> chunks;
+    for(int row=0; row<mask.height(); row+=64)
+        chunks.append(row);
+    QtConcurrent::blockingMap(chunks, [&](int first) {
+        int last = std::min(first + 64, mask.height());
+        for(int row=first; row<last; row++)
+            memset(bits + row * bpl, 1, mask.width());
+
+        // Runs are in raster order
+        auto run = std::lower_bound(found.runs.cbegin(), found.runs.cend(), first,
+                                    [](const MonoRun &r, int row) { return r.row < row; });
+        for(; (run != found.runs.cend()) && (run->row < last); ++run)
+        {
+            if (table[run->label] == 0)
+                memset(bits + run->row * bpl + run->start, 0, run->end - run->start);
+        }
+    });
     return mask;
 }
 
@@ -299,15 +734,27 @@ QImage Page::despeckle(int blobSize, bool invert, int *blobs)
 //
 QImage Page::floodFill(QPoint loc, int threshold)
 {
-    // Upconvert mono images
-    QImage img;
+    // Fill mono images on the packed bits
     if (m_img.format() == QImage::Format_Mono)
-        img = m_img.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
-    else
-        img = m_img;
+    {
+        QImage mask(m_img.size(), QImage::Format_Indexed8);
+        mask.setColor( 0, qRgba(0,0,0,0));  // Place holder - replaced in blinker/applyMask
+        mask.setColor( 1, qRgba(0,0,0,0));  // Transparent
+
+        // Black and white are 255 apart, so only a full range crosses between them
+        if (threshold >= 255)
+            mask.fill(0);
+        else
+        {
+            mask.fill(1);
+            monoFloodFill(m_img, loc, mask);
+        }
+        return mask;
+    }
+    QImage img = m_img;
 
-    // Convert to OpenCV
-    cv::Mat orig = QImage2OCV(img);
+    // View as OpenCV
+    cv::Mat orig = QImage2OCVView(img);
     if ((img.format() == QImage::Format_RGB32) || (img.format() == QImage::Format_ARGB32))
         cv::cvtColor(orig, orig, cv::COLOR_RGBA2RGB);   // floodfill doesn't work with alpha channel
 
@@ -321,21 +768,17 @@ QImage Page::floodFill(QPoint loc, int threshold)
     int flags = 8 | (255 << 8 ) | cv::FLOODFILL_FIXED_RANGE | cv::FLOODFILL_MASK_ONLY;
     cv::floodFill(orig, floodMask, ref, 0, &region, thresh, thresh, flags);
 
-    // Convert mask back
-    QImage tmp = OCV2QImage(floodMask);
-    tmp = tmp.copy(1, 1, tmp.width() - 2, tmp.height() - 2);
-
     // Initialize mask
     QImage mask(img.size(), QImage::Format_Indexed8);
     mask.setColor( 0, qRgba(0,0,0,0));  // Place holder - replaced in blinker/applyMask
     mask.setColor( 1, qRgba(0,0,0,0));  // Transparent
 
-    // Scan through page seeking matches
-    for(int i=0; i<tmp.height(); i++)
+    // Read the flood mask in place, skipping its one pixel border
+    for(int i=0; i<img.height(); i++)
     {
-        uchar *srcPtr = tmp.scanLine(i);
+        const uchar *srcPtr = floodMask.ptr<uchar>(i + 1) + 1;
         uchar *maskPtr = reinterpret_cast<uchar*>(mask.scanLine(i));
-        for(int j=0; j<tmp.width(); j++)
+        for(int j=0; j<img.width(); j++)
         {
             if (*srcPtr++ <= 128)
                 *maskPtr++ = 1;
@@ -358,71 +801,90 @@ void Page::applyMask(QImage mask, QColor color)
 }
 
 //
-// Rotate the image by a small amount
+// Pack a binary matrix into a Format_Mono image, nonzero pixels black
+//     Rows are built 32 pixels to a word, leftmost pixel in the most
+//     significant bit, and stored big endian to match the MSB first
+//     scanlines. Scanlines are padded to whole words.
 //
-QImage Page::deskew(float angle)
+static QImage packMono(const cv::Mat &bin)
 {
-    // Run this in a thread to avoid lagging the UI
-#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-    QFuture<QImage> future = QtConcurrent::run(&Page::deskewThread, this, angle);
-#else
-    QFuture<QImage> future = QtConcurrent::run(this, &Page::deskewThread, angle);
-#endif
-    while (!future.isFinished())
+    QImage img(bin.cols, bin.rows, QImage::Format_Mono);
+    img.setColor(0, qRgb(255, 255, 255));
+    img.setColor(1, qRgb(0, 0, 0));
+    for(int i=0; i<bin.rows; i++)
     {
-        QApplication::processEvents();
-        QThread::msleep(1); //yield
+        const uchar *src = bin.ptr<uchar>(i);
+        uchar *dst = img.scanLine(i);
+        int j = 0;
+        for(; j+32<=bin.cols; j+=32, dst+=4)
+        {
+            quint32 word = 0;
+            for(int bit=0; bit<32; bit++)
+                word = (word << 1) | (src[j + bit] ? 1 : 0);
+            qToBigEndian(word, dst);
+        }
+        if (j < bin.cols)
+        {
+            quint32 word = 0;
+            for(int bit=0; j+bit<bin.cols; bit++)
+                word |= (quint32)(src[j + bit] ? 1 : 0) << (31 - bit);
+            qToBigEndian(word, dst);
+        }
     }
-    future.waitForFinished();
-    return future.result();
-}
-
-QImage Page::deskewThread(float angle)
-{
-    QTransform tmat = QTransform().rotate(angle);
-    return m_img.transformed(tmat, Qt::SmoothTransformation);
+    return img;
 }
 
 //
 // Calculate deskew angle
+//     The search is coarse-to-fine on a bit packed copy, see monoFindSkew.
+//     textOnly skips margins and borders, conf and msecs report the
+//     confidence of the answer and how long it took.
 //
-float Page::calcDeskew()
+float Page::calcDeskew(bool textOnly, float *conf, qint64 *msecs)
 {
-    QImage tmpImage = m_img;
-    if (tmpImage.format() != QImage::Format_Grayscale8)
-        tmpImage = tmpImage.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
+    QElapsedTimer timer;
+    timer.start();
 
-    // Convert to OpenCV
-    cv::Mat mat = QImage2OCV(tmpImage);
+    QImage bits;
+    int ink = 1;
+    if (m_img.format() == QImage::Format_Mono)
+    {
+        // Mono pages are already binary
+        bits = m_img;
+        ink = monoInk(m_img);
+    }
+    else
+    {
+        QImage tmpImage = m_img;
+        if (tmpImage.format() != QImage::Format_Grayscale8)
+            tmpImage = tmpImage.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
 
-    // Convert to binary
-    cv::Mat bin;
-    cv::threshold(mat, bin, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+        // View as OpenCV
+        cv::Mat mat = QImage2OCVView(tmpImage);
 
-    // Convert to PIX
-    PIX *pixS = pixCreate(bin.size().width, bin.size().height, 1);
-    for(int i=0; i<bin.rows; i++)
-        for(int j=0; j<bin.cols; j++)
-            pixSetPixel(pixS, j, i, (l_uint32) bin.at<uchar>(i,j) & 1);
-
-    // Find skew angle
-    l_float32 angle, conf;
-    float retval;
-    if (pixFindSkew(pixS, &angle, &conf))
-        retval = 0.0;
-    else
-        retval = angle;
-    pixDestroy(&pixS);
-    return retval;
+        // Convert to binary
+        cv::Mat bin;
+        cv::threshold(mat, bin, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+        bits = packMono(bin);
+    }
+
+    float angle = monoFindSkew(bits, ink, textOnly, conf);
+    if (msecs != nullptr)
+        *msecs = timer.elapsed();
+    return angle;
 }
 
 //
-// Apply the deskew image
+// Rotate the image about its center by a small amount
+//     Done once at full resolution, the Viewer previews the rotation
+//     from its screen tiles
 //
-void Page::applyDeskew(QImage img)
+void Page::applyDeskew(float angle)
 {
-    // Paint the deskew image rotated about the center
-    // Note: This code is identical to paintEvent
+    QTransform tmat = QTransform().rotate(angle);
+    QImage img = m_img.transformed(tmat, Qt::SmoothTransformation);
+
+    // Paint the rotated image centered on the original
     QPainter p(&m_img);
     QRect rect(img.rect());
     rect.moveCenter(m_img.rect().center());
@@ -435,26 +897,36 @@ void Page::applyDeskew(QImage img)
 //
 void Page::doCenter(QColor bg)
 {
-    // Convert to grayscale
-    QImage img;
-    if (m_img.format() != QImage::Format_Grayscale8)
-        img = m_img.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
+    QRect box;
+    if (m_img.format() == QImage::Format_Mono)
+    {
+        // Bounding box of the black pixels
+        box = monoBoundingRect(m_img, monoInk(m_img));
+    }
     else
-        img = m_img;
-
-    // Convert to openCV
-    cv::Mat orig = QImage2OCV(img);
-
-    // Invert
-    cv::Mat inverted;
-    cv::bitwise_not(orig, inverted);
-
-    // Calculate bounding box
-    cv::Rect box = cv::boundingRect(inverted);
+    {
+        // Convert to grayscale
+        QImage img;
+        if (m_img.format() != QImage::Format_Grayscale8)
+            img = m_img.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
+        else
+            img = m_img;
+
+        // View as openCV
+        cv::Mat orig = QImage2OCVView(img);
+
+        // Invert
+        cv::Mat inverted;
+        cv::bitwise_not(orig, inverted);
+
+        // Calculate bounding box
+        cv::Rect rect = cv::boundingRect(inverted);
+        box = QRect(rect.x, rect.y, rect.width, rect.height);
+    }
 
     // Calculate margins
-    int left = (m_img.width() - box.width) / 2 - box.x;
-    int top = (m_img.height() - box.height) / 2 - box.y;
+    int left = (m_img.width() - box.width()) / 2 - box.x();
+    int top = (m_img.height() - box.height()) / 2 - box.y();
 
     // Paint image onto m_img with calculated offset
     QImage tmp = m_img;
@@ -477,30 +949,28 @@ void Page::toGrayscale()
 //
 void Page::toBinary(bool adaptive, int blur, int kernel)
 {
-    // Run this in a thread to avoid lagging the UI
-#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-    QFuture<void> future = QtConcurrent::run(&Page::toBinaryThread, this, adaptive, blur, kernel);
-#else
-    QFuture<void> future = QtConcurrent::run(this, &Page::toBinaryThread, adaptive, blur, kernel);
-#endif
-    while (!future.isFinished())
-    {
-        QApplication::processEvents();
-        QThread::msleep(1); //yield
-    }
-    future.waitForFinished();
+    m_img = binaryImage(m_img, adaptive, blur, kernel);
+}
+
+//
+// Start binary conversion in the background
+//     Result must be stored into m_img by the caller
+//
+QFuture<QImage> Page::toBinaryAsync(bool adaptive, int blur, int kernel)
+{
+    return QtConcurrent::run(&Page::binaryImage, m_img, adaptive, blur, kernel);
 }
 
 //
-// Convert to binary thread
+// Convert image to binary
 //
-void Page::toBinaryThread(bool adaptive, int blur, int kernel)
+QImage Page::binaryImage(QImage src, bool adaptive, int blur, int kernel)
 {
     // Convert to grayscale
-    QImage img = m_img.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
+    QImage img = src.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
 
-    // Convert to OpenCV
-    cv::Mat mat = QImage2OCV(img);
+    // View as OpenCV
+    cv::Mat mat = QImage2OCVView(img);
 
     // Gausian filter to clean up noise
     if (true)
@@ -524,16 +994,16 @@ void Page::toBinaryThread(bool adaptive, int blur, int kernel)
     }
 
     // Convert back to QImage and reformat
-    img = OCV2QImage(mat);
+    img = OCV2QImageView(mat);
     img = img.convertToFormat(QImage::Format_Mono, Qt::MonoOnly|Qt::ThresholdDither|Qt::AvoidDither);
 
     // Copy metadata
-    img.setDotsPerMeterX(m_img.dotsPerMeterX());
-    img.setDotsPerMeterY(m_img.dotsPerMeterY());
-    for (const auto& i : m_img.textKeys())
-        img.setText(i, m_img.text(i));
+    img.setDotsPerMeterX(src.dotsPerMeterX());
+    img.setDotsPerMeterY(src.dotsPerMeterY());
+    for (const auto& i : src.textKeys())
+        img.setText(i, src.text(i));
 
-    m_img = img;
+    return img;
 }
 
 //
@@ -2,8 +2,13 @@
 
 #ifndef PAGE_H
 #define PAGE_H
+#include "Utils/ImagePack.h"
+#include "Utils/MonoKernels.h"
+#include <QFuture>
 #include <QImage>
 #include <QMetaType>
+#include <QRect>
+#include <QSharedPointer>
 
 class Page
 {
@@ -15,23 +20,36 @@ public:
     ~Page();
 
     // Methods
+    bool loaded();
+    bool load();
+    bool unload();
+    bool spill();
+    qint64 memoryUsage();
+    void normalize();
     bool modified();
     void flush();
     void push();
+    void push(QRect rect);
+    void extend(QRect rect);
     bool undo();
     bool redo();
-    QImage peek();
+    QImage::Format peekFormat();
+    QRect takeDirty();
+    QRect takeIconDirty();
+    static QRect maskRect(const QImage &mask);
     QImage colorSelect(QRgb target, int threshold);
+    QImage distanceMap(QRgb target);
+    static QImage thresholdMask(const QImage &dist, int threshold);
     QImage deColor(int threshold);
     QImage despeckle(int blobSize, bool invert, int *blobs = nullptr);
     QImage floodFill(QPoint loc, int threshold);
     void applyMask(QImage mask, QColor color);
-    QImage deskew(float angle);
-    float calcDeskew();
-    void applyDeskew(QImage img);
+    float calcDeskew(bool textOnly = false, float *conf = nullptr, qint64 *msecs = nullptr);
+    void applyDeskew(float angle);
     void doCenter(QColor bg);
     void toGrayscale();
     void toBinary(bool adaptive, int blur, int kernel=1);
+    QFuture<QImage> toBinaryAsync(bool adaptive, int blur, int kernel=1);
     void toDithered();
 
     // Flag if image was changed
@@ -45,14 +63,44 @@ public:
     // The main image
     QImage m_img;
 
+    // File the image came from, used to read it on demand
+    QString m_fileName;
+
+    // Scratch file holding the page while it is evicted
+    QString m_spillFile;
+
 private:
-    QImage deskewThread(float angle);
-    void toBinaryThread(bool adaptive, int blur, int kernel);
+    // One undo/redo step, either the whole image or the pixels
+    // that were under rect before an edit in place
+    struct UndoStep
+    {
+        PackedImage img;
+        QRect rect;
+        bool full = true;
+        QImage::Format format = QImage::Format_Invalid;
+    };
+
+    bool unspill();
+    UndoStep swapStep(const UndoStep &step);
+    void trimHistory();
+    struct BlobCache;
+    MonoBlobs components(bool invert);
+    static QImage binaryImage(QImage img, bool adaptive, int blur, int kernel);
+
+    // Area changed by edits since takeDirty, and the image it was taken from
+    QRect m_dirty;
+    qint64 m_dirtyKey = 0;
+
+    // Same for the list icon, taken when the Viewer requests a new one
+    QRect m_iconDirty;
+
+    // Undo buffers, newest first
+    QList<UndoStep> m_undo;
+    QList<UndoStep> m_redo;
 
-    // Undo buffers
-#define MAX_UNDO 8
-    QList<QImage> m_undo;
-    QList<QImage> m_redo;
+    // Labels for despeckle/devoid, shared by copies so that work done
+    // on a copy in the background is kept. Replaced on every edit.
+    QSharedPointer<BlobCache> m_blobCache;
 };
 
 Q_DECLARE_METATYPE(Page)
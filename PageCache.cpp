@@ -0,0 +1,85 @@
+// PageCache.cpp
+
+#include "PageCache.h"
+#include "Config.h"
+#include "PageItem.h"
+#include <QDebug>
+#include <QFile>
+
+PageCache::PageCache()
+{
+    if (!m_scratch.isValid())
+        qWarning() << "No scratch directory, modified pages stay in memory:" << m_scratch.errorString();
+}
+
+PageCache::~PageCache()
+{
+}
+
+//
+// Mark page as most recently used
+//
+void PageCache::touch(QListWidgetItem *item)
+{
+    m_lru.removeOne(item);
+    m_lru.prepend(item);
+}
+
+//
+// Forget an item that is being deleted
+//
+void PageCache::remove(QListWidgetItem *item)
+{
+    m_lru.removeOne(item);
+    Page &page = PageItem::pageOf(item);
+    if (!page.m_spillFile.isEmpty())
+        QFile(page.m_spillFile).remove();
+}
+
+//
+// Evict least recently used pages until under the memory budget
+//     Unmodified pages are dropped and read again from their file,
+//     anything with history is written to the scratch directory
+//
+void PageCache::trim(QListWidgetItem *keep)
+{
+    qint64 budget = (qint64)Config::memoryBudget * 1024 * 1024;
+
+    // Add up what is in memory
+    qint64 total = 0;
+    foreach(QListWidgetItem *item, m_lru)
+        total += PageItem::pageOf(item).memoryUsage();
+
+    // Evict starting at the oldest
+    for(int idx=m_lru.count()-1; (idx >= 0) && (total > budget); idx--)
+    {
+        QListWidgetItem *item = m_lru.at(idx);
+        if (item == keep)
+            continue;
+
+        Page &page = PageItem::pageOf(item);
+        qint64 bytes = page.memoryUsage();
+        if (page.loaded() && !page.unload())
+        {
+            if (page.m_spillFile.isEmpty())
+                page.m_spillFile = spillPath();
+            if (page.m_spillFile.isEmpty() || !page.spill())
+                continue;
+        }
+        m_lru.removeAt(idx);
+        total -= bytes;
+    }
+}
+
+//
+// Make a new scratch file name
+//     Empty if the scratch directory couldn't be created, in which
+//     case pages are kept in memory
+//
+QString PageCache::spillPath()
+{
+    if (!m_scratch.isValid())
+        return QString();
+    m_spillCount++;
+    return QStringLiteral("%1/%2.page").arg(m_scratch.path()).arg(m_spillCount);
+}
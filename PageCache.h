@@ -0,0 +1,32 @@
+// PageCache.h
+
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include "Page.h"
+#include <QList>
+#include <QListWidgetItem>
+#include <QTemporaryDir>
+
+class PageCache
+{
+public:
+    PageCache();
+    ~PageCache();
+
+    // Methods
+    void touch(QListWidgetItem *item);
+    void remove(QListWidgetItem *item);
+    void trim(QListWidgetItem *keep = nullptr);
+    QString spillPath();
+
+private:
+    // Items with pages in memory, most recently used first
+    QList<QListWidgetItem*> m_lru;
+
+    // Scratch directory for modified pages
+    QTemporaryDir m_scratch;
+    int m_spillCount = 0;
+};
+
+#endif // PAGECACHE_H
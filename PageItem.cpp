@@ -0,0 +1,46 @@
+// PageItem.cpp
+
+#include "PageItem.h"
+#include <QPixmap>
+
+PageItem::PageItem(const Page &page) : QListWidgetItem(nullptr, QListWidgetItem::UserType), m_page(page)
+{
+}
+
+PageItem::~PageItem()
+{
+}
+
+//
+// Build the icon the first time the view asks for it
+//
+QVariant PageItem::data(int role) const
+{
+    if ((role == Qt::DecorationRole) && !m_icon.isNull())
+    {
+        if (m_iconCache.isNull())
+            m_iconCache = QIcon(QPixmap::fromImage(m_icon));
+        return m_iconCache;
+    }
+    return QListWidgetItem::data(role);
+}
+
+//
+// Replace the icon image and have the view repaint the entry
+//     The stored decoration is only a change count, the icon itself
+//     comes from data()
+//
+void PageItem::setIconImage(const QImage &icon)
+{
+    m_icon = icon;
+    m_iconCache = QIcon();
+    QListWidgetItem::setData(Qt::DecorationRole, ++m_iconSerial);
+}
+
+//
+// Page held by a list entry
+//
+Page &PageItem::pageOf(QListWidgetItem *item)
+{
+    return static_cast<PageItem*>(item)->m_page;
+}
@@ -0,0 +1,37 @@
+// PageItem.h
+
+#ifndef PAGEITEM_H
+#define PAGEITEM_H
+
+#include "Page.h"
+#include <QIcon>
+#include <QImage>
+#include <QListWidgetItem>
+
+//
+// List entry that owns its page
+//     The page is edited in place through pageOf instead of being
+//     boxed in a QVariant, and the icon is kept as an image that is
+//     only turned into a QIcon the first time the view paints the entry
+//
+class PageItem : public QListWidgetItem
+{
+public:
+    PageItem(const Page &page = Page());
+    ~PageItem();
+
+    // Methods
+    QVariant data(int role) const override;
+    void setIconImage(const QImage &icon);
+    static Page &pageOf(QListWidgetItem *item);
+
+    // The page shown by this entry
+    Page m_page;
+
+private:
+    QImage m_icon;
+    mutable QIcon m_iconCache;
+    int m_iconSerial = 0;
+};
+
+#endif // PAGEITEM_H
@@ -0,0 +1,445 @@
+// ThumbService.cpp
+
+#include "ThumbService.h"
+#include "PageItem.h"
+#include "Utils/MonoKernels.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPainter>
+#include <QPainterPath>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QVector>
+#include <QtAlgorithms>
+
+//
+// Draws one icon on the service's pool
+//
+class ThumbTask : public QRunnable
+{
+public:
+    ThumbTask(ThumbService *service, QListWidgetItem *item, quint64 serial,
+              const ThumbService::Request &req, const ThumbService::Thumb &thumb)
+        : m_service(service), m_item(item), m_serial(serial), m_req(req), m_thumb(thumb)
+    {
+    }
+
+    void run() override
+    {
+        // Stay out of the way of the batch engine and the Viewer
+        QThread::currentThread()->setPriority(QThread::LowPriority);
+        ThumbService::refresh(m_thumb, m_req.image, m_req.dirty);
+        QImage icon = ThumbService::iconImage(m_thumb.small, m_req.flag, m_req.image.format());
+        m_req.image = QImage();
+
+        ThumbService *service = m_service;
+        QListWidgetItem *item = m_item;
+        quint64 serial = m_serial;
+        ThumbService::Thumb thumb = m_thumb;
+        QMetaObject::invokeMethod(service, [service, item, serial, icon, thumb]() {
+            service->finished(item, serial, icon, thumb);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    ThumbService *m_service;
+    QListWidgetItem *m_item;
+    quint64 m_serial;
+    ThumbService::Request m_req;
+    ThumbService::Thumb m_thumb;
+};
+
+ThumbService::ThumbService(QObject *parent) : QObject(parent)
+{
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+ThumbService::~ThumbService()
+{
+    m_pool.waitForDone();
+}
+
+//
+// Queue a new icon for the item
+//     dirty is the part of the image changed since the last request,
+//     empty if only the flag changed
+//
+void ThumbService::request(QListWidgetItem *item, const QImage &image, bool flag, QRect dirty)
+{
+    Request req;
+    req.image = image;
+    req.flag = flag;
+    req.dirty = dirty;
+
+    // Replace whatever was waiting, the running one finishes first
+    if (m_running.contains(item))
+    {
+        req.dirty |= m_pending.value(item).dirty;
+        m_pending.insert(item, req);
+    }
+    else
+        start(item, req);
+}
+
+//
+// Forget an item that is being deleted
+//
+void ThumbService::remove(QListWidgetItem *item)
+{
+    m_running.remove(item);
+    m_pending.remove(item);
+    m_thumbs.remove(item);
+}
+
+//
+// Hand a request to the pool
+//
+void ThumbService::start(QListWidgetItem *item, const Request &req)
+{
+    quint64 serial = ++m_serial;
+    m_running.insert(item, serial);
+    m_pool.start(new ThumbTask(this, item, serial, req, m_thumbs.value(item)));
+}
+
+//
+// Show the finished icon unless a newer one is already waiting
+//
+void ThumbService::finished(QListWidgetItem *item, quint64 serial, QImage icon, Thumb thumb)
+{
+    // Item was deleted, or deleted and its address reused
+    if (m_running.value(item) != serial)
+        return;
+    m_running.remove(item);
+    m_thumbs.insert(item, thumb);
+
+    // Pending dirty rects are relative to the buffer just stored
+    if (m_pending.contains(item))
+        start(item, m_pending.take(item));
+    else
+        static_cast<PageItem*>(item)->setIconImage(icon);
+}
+
+//
+// Count set bits of an MSB first row from x0 up to x1
+//
+static int countBits(const uchar *s, int x0, int x1)
+{
+    int b0 = x0 >> 3;
+    int b1 = (x1 - 1) >> 3;
+    quint8 m0 = 0xff >> (x0 & 7);
+    quint8 m1 = 0xff << (7 - ((x1 - 1) & 7));
+    if (b0 == b1)
+        return qPopulationCount((quint8)(s[b0] & m0 & m1));
+
+    int n = qPopulationCount((quint8)(s[b0] & m0)) + qPopulationCount((quint8)(s[b1] & m1));
+    for(int b=b0+1; b<b1; b++)
+        n += qPopulationCount((quint8)s[b]);
+    return n;
+}
+
+//
+// Average factor x factor blocks of a bitonal image into grayscale
+//     Only the blocks inside rect are written to dst
+//
+static void shrinkMono(const QImage &src, int factor, const QRect &rect, QImage &dst)
+{
+    QVector<int> ones(rect.width());
+    int ink = monoInk(src);
+
+    for(int oy=rect.top(); oy<=rect.bottom(); oy++)
+    {
+        int y0 = oy * factor;
+        int y1 = qMin(y0 + factor, src.height());
+        ones.fill(0);
+        for(int y=y0; y<y1; y++)
+        {
+            const uchar *s = src.constScanLine(y);
+            for(int ox=rect.left(); ox<=rect.right(); ox++)
+                ones[ox - rect.left()] += countBits(s, ox * factor, qMin((ox + 1) * factor, src.width()));
+        }
+
+        uchar *d = dst.scanLine(oy);
+        for(int ox=rect.left(); ox<=rect.right(); ox++)
+        {
+            int n = (qMin((ox + 1) * factor, src.width()) - ox * factor) * (y1 - y0);
+            int on = ones[ox - rect.left()];
+            int paper = (ink == 1) ? n - on : on;
+            d[ox] = (255 * paper + n / 2) / n;
+        }
+    }
+}
+
+//
+// Average factor x factor blocks of an image with 8 bit channels
+//     Channels are summed byte by byte so the format is kept as is
+//
+static void shrinkBytes(const QImage &src, int factor, int bpp, const QRect &rect, QImage &dst)
+{
+    QVector<quint32> sums(rect.width() * bpp);
+
+    for(int oy=rect.top(); oy<=rect.bottom(); oy++)
+    {
+        int y0 = oy * factor;
+        int y1 = qMin(y0 + factor, src.height());
+        sums.fill(0);
+        for(int y=y0; y<y1; y++)
+        {
+            const uchar *s = src.constScanLine(y);
+            quint32 *acc = sums.data();
+            for(int ox=rect.left(); ox<=rect.right(); ox++, acc+=bpp)
+            {
+                int x1 = qMin((ox + 1) * factor, src.width());
+                for(int x=ox*factor; x<x1; x++)
+                    for(int c=0; c<bpp; c++)
+                        acc[c] += s[x * bpp + c];
+            }
+        }
+
+        uchar *d = dst.scanLine(oy);
+        const quint32 *acc = sums.constData();
+        for(int ox=rect.left(); ox<=rect.right(); ox++, acc+=bpp)
+        {
+            quint32 n = (qMin((ox + 1) * factor, src.width()) - ox * factor) * (y1 - y0);
+            for(int c=0; c<bpp; c++)
+                d[ox * bpp + c] = (acc[c] + n / 2) / n;
+        }
+    }
+}
+
+//
+// Average the blocks inside rect, picking the kernel for the format
+//
+static void shrinkBlocks(const QImage &src, int factor, const QRect &rect, QImage &dst)
+{
+    switch (src.format())
+    {
+        case QImage::Format_Mono:
+            shrinkMono(src, factor, rect, dst);
+            break;
+        case QImage::Format_Grayscale8:
+            shrinkBytes(src, factor, 1, rect, dst);
+            break;
+        case QImage::Format_RGB888:
+            shrinkBytes(src, factor, 3, rect, dst);
+            break;
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+        case QImage::Format_ARGB32_Premultiplied:
+            shrinkBytes(src, factor, 4, rect, dst);
+            break;
+        default:
+            shrinkBytes(src.convertToFormat(QImage::Format_RGB32), factor, 4, rect, dst);
+            break;
+    }
+}
+
+//
+// Format the blocks of an image are averaged into
+//
+static QImage::Format shrinkFormat(QImage::Format format)
+{
+    switch (format)
+    {
+        case QImage::Format_Mono:
+            return QImage::Format_Grayscale8;
+        case QImage::Format_Grayscale8:
+        case QImage::Format_RGB888:
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+        case QImage::Format_ARGB32_Premultiplied:
+            return format;
+        default:
+            return QImage::Format_RGB32;
+    }
+}
+
+//
+// Box filter the image down to at most twice the bound, so the final
+// smooth scaling only touches a small image
+//
+QImage ThumbService::shrink(const QImage &image, int bound)
+{
+    int factor = qMax(image.width(), image.height()) / bound;
+    if (factor < 2)
+        return image;
+
+    QImage dst((image.width() + factor - 1) / factor, (image.height() + factor - 1) / factor,
+               shrinkFormat(image.format()));
+    shrinkBlocks(image, factor, dst.rect(), dst);
+    return dst;
+}
+
+//
+// Bring the downscaled page up to date with the image
+//     Starts over if the size or format changed, otherwise only the
+//     blocks touching dirty are averaged again
+//
+void ThumbService::refresh(Thumb &thumb, const QImage &image, QRect dirty)
+{
+    if (image.isNull())
+        return;
+
+    if (thumb.small.isNull() || (thumb.size != image.size()) || (thumb.format != image.format()))
+    {
+        thumb.factor = qMax(1, qMax(image.width(), image.height()) / ICON_SIZE);
+        thumb.size = image.size();
+        thumb.format = image.format();
+        thumb.small = QImage((image.width() + thumb.factor - 1) / thumb.factor,
+                             (image.height() + thumb.factor - 1) / thumb.factor,
+                             shrinkFormat(image.format()));
+        dirty = image.rect();
+    }
+
+    dirty &= image.rect();
+    if (dirty.isEmpty())
+        return;
+    QRect blocks(QPoint(dirty.left() / thumb.factor, dirty.top() / thumb.factor),
+                 QPoint(dirty.right() / thumb.factor, dirty.bottom() / thumb.factor));
+    shrinkBlocks(image, thumb.factor, blocks, thumb.small);
+}
+
+//
+// Draw the icon image, safe to call from worker threads
+//
+QImage ThumbService::iconImage(const QImage &image, bool flag, QImage::Format format)
+{
+    // Fill background
+    QImage qimg(ICON_SIZE, ICON_SIZE, QImage::Format_RGB32);
+    qimg.fill(QColor(240, 240, 240));
+
+    // Draw image
+    QPainter painter(&qimg);
+    QImage scaledImage = shrink(image, ICON_SIZE).scaled(ICON_SIZE, ICON_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    if (scaledImage.width() > scaledImage.height())
+    {
+        float m = (ICON_SIZE - scaledImage.height()) / 2.0;
+        painter.drawImage(QPoint(0,m), scaledImage);
+    } else {
+        float m = (ICON_SIZE - scaledImage.width()) / 2.0;
+        painter.drawImage(QPoint(m,0), scaledImage);
+    }
+
+    // Mark if changed
+    if (flag)
+    {
+        QPainterPath path = QPainterPath();
+        path.addRect(QRectF(2,2,10,10));
+        painter.fillPath(path, Qt::red);
+        painter.drawPath(path);
+    }
+
+    // Display format
+    QString txt = "";
+    if (format == QImage::Format_Invalid)
+        format = image.format();
+    switch (format)
+    {
+        case QImage::Format_RGB888:
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+            txt = "RGB";
+            break;
+        case QImage::Format_Grayscale8:
+            txt = "GS";
+            break;
+        case QImage::Format_Mono:
+            txt = "BW";
+            break;
+        default:
+            txt = "???";
+            break;
+    }
+    painter.setPen(Qt::black);
+    painter.setFont(QFont("Courier", 8));
+    painter.drawText(QRect(0,0,ICON_SIZE,ICON_SIZE), Qt::AlignRight|Qt::AlignBottom, txt);
+
+    painter.end();
+    return qimg;
+}
+
+//
+// Directory holding icons of files read before
+//
+static QString iconDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/icons";
+}
+
+//
+// Name of a file's icon in the disk cache
+//     Path, time and size catch most changes, a hash of both ends of
+//     the file catches files that were replaced while keeping those.
+//     Hashing all of it would cost about as much as decoding it.
+//
+QString ThumbService::fileKey(const QString &fileName)
+{
+    QFileInfo info(fileName);
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(info.absoluteFilePath().toUtf8());
+    hash.addData(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+    hash.addData(QByteArray::number(info.size()));
+    hash.addData(file.read(ICON_SAMPLE));
+    if (info.size() > ICON_SAMPLE)
+    {
+        file.seek(qMax((qint64)ICON_SAMPLE, info.size() - ICON_SAMPLE));
+        hash.addData(file.read(ICON_SAMPLE));
+    }
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+//
+// Read an icon from the disk cache, null if it isn't there
+//
+QImage ThumbService::loadIcon(const QString &key)
+{
+    if (key.isEmpty())
+        return QImage();
+    QImage icon(iconDir() + "/" + key + ".png");
+    if (icon.size() != QSize(ICON_SIZE, ICON_SIZE))
+        return QImage();
+    return icon;
+}
+
+//
+// Save an icon to the disk cache, safe to call from worker threads
+//
+void ThumbService::storeIcon(const QString &key, const QImage &icon)
+{
+    if (key.isEmpty() || icon.isNull())
+        return;
+    QString dir = iconDir();
+    if (!QDir().mkpath(dir))
+        return;
+
+    // Written under a temporary name so readers never see half an icon
+    QSaveFile file(dir + "/" + key + ".png");
+    if (file.open(QIODevice::WriteOnly) && icon.save(&file, "PNG"))
+        file.commit();
+}
+
+//
+// Keep the disk cache to ICON_CACHE_FILES icons by deleting the ones
+// written longest ago
+//     Run once an import is done rather than on every store, since it
+//     has to look at every file in the cache
+//
+void ThumbService::trimIcons()
+{
+    QDir dir(iconDir());
+    if (dir.entryList(QStringList("*.png"), QDir::Files).count() <= ICON_CACHE_FILES)
+        return;
+
+    // Newest first, anything past the cap goes
+    QFileInfoList icons = dir.entryInfoList(QStringList("*.png"), QDir::Files, QDir::Time);
+    for(int idx=ICON_CACHE_FILES; idx<icons.count(); idx++)
+        QFile::remove(icons.at(idx).absoluteFilePath());
+}
@@ -0,0 +1,89 @@
+// ThumbService.h
+
+#ifndef THUMBSERVICE_H
+#define THUMBSERVICE_H
+
+#include <QHash>
+#include <QImage>
+#include <QListWidgetItem>
+#include <QObject>
+#include <QThreadPool>
+
+// Edge of the square list icons
+#define ICON_SIZE 100
+
+// Bytes read from each end of a file for its disk cache key
+#define ICON_SAMPLE (64 * 1024)
+
+// Icons kept in the disk cache before the oldest are deleted
+#define ICON_CACHE_FILES 5000
+
+//
+// Draws list icons in the background
+//     Requests for an item that is already being drawn are held and
+//     only the latest is drawn once the running one is done, so a
+//     burst of edits costs at most two icons. Items keep showing their
+//     old icon until the new one is ready.
+//
+//     Each item keeps its page box filtered down to icon scale, so an
+//     edit only has to average the blocks under its dirty rect before
+//     the small buffer is scaled into the icon.
+//
+//     Icons of files as they were read are also kept on disk, so that
+//     opening the same files again doesn't have to decode them.
+//
+class ThumbService : public QObject
+{
+    Q_OBJECT
+
+public:
+    ThumbService(QObject *parent = nullptr);
+    ~ThumbService();
+
+    // Methods
+    void request(QListWidgetItem *item, const QImage &image, bool flag, QRect dirty = QRect(0, 0, INT_MAX, INT_MAX));
+    void remove(QListWidgetItem *item);
+    static QImage iconImage(const QImage &image, bool flag, QImage::Format format = QImage::Format_Invalid);
+    static QImage shrink(const QImage &image, int bound);
+    static QString fileKey(const QString &fileName);
+    static QImage loadIcon(const QString &key);
+    static void storeIcon(const QString &key, const QImage &icon);
+    static void trimIcons();
+
+private:
+    friend class ThumbTask;
+
+    struct Request
+    {
+        QImage image;
+        bool flag = false;
+        QRect dirty;
+    };
+
+    // Page averaged over factor x factor blocks
+    struct Thumb
+    {
+        QImage small;
+        int factor = 0;
+        QSize size;
+        QImage::Format format = QImage::Format_Invalid;
+    };
+
+    void start(QListWidgetItem *item, const Request &req);
+    void finished(QListWidgetItem *item, quint64 serial, QImage icon, Thumb thumb);
+    static void refresh(Thumb &thumb, const QImage &image, QRect dirty);
+
+    // Item being drawn and the serial of its request
+    QHash<QListWidgetItem*, quint64> m_running;
+
+    // Latest request for items still being drawn
+    QHash<QListWidgetItem*, Request> m_pending;
+
+    // Downscaled pages, only touched on the GUI thread
+    QHash<QListWidgetItem*, Thumb> m_thumbs;
+
+    quint64 m_serial = 0;
+    QThreadPool m_pool;
+};
+
+#endif // THUMBSERVICE_H
@@ -29,13 +29,13 @@ UI_DIR = ./.build
 QT += widgets gui concurrent
 
 # Input
-HEADERS += mainwindow.h Bookmarks.h Config.h Page.h Viewer.h
-HEADERS += Utils/QImage2OCV.h
+HEADERS += mainwindow.h Batch.h Bookmarks.h Config.h Page.h PageCache.h PageItem.h ThumbService.h TileCache.h Viewer.h
+HEADERS += Utils/ColorKernels.h Utils/ImagePack.h Utils/MonoKernels.h Utils/QImage2OCV.h
 HEADERS += Widgets/ColorQToolButton.h Widgets/DoubleSpinWidget.h Widgets/OddSpinBox.h Widgets/OddSpinWidget.h
 HEADERS += Widgets/PopupQToolButton.h Widgets/SpinWidget.h
 FORMS += mainWin.ui
-SOURCES += main.cpp mainwindow.cpp Bookmarks.cpp Config.cpp Page.cpp Viewer.cpp
-SOURCES += Utils/QImage2OCV.cpp
+SOURCES += main.cpp mainwindow.cpp Batch.cpp Bookmarks.cpp Config.cpp Page.cpp PageCache.cpp PageItem.cpp ThumbService.cpp TileCache.cpp Viewer.cpp
+SOURCES += Utils/ColorKernels.cpp Utils/ImagePack.cpp Utils/MonoKernels.cpp Utils/QImage2OCV.cpp
 SOURCES += Widgets/ColorQToolButton.cpp Widgets/DoubleSpinWidget.cpp Widgets/OddSpinBox.cpp Widgets/OddSpinWidget.cpp
 SOURCES += Widgets/PopupQToolButton.cpp Widgets/SpinWidget.cpp
 RESOURCES += rsrc.qrc
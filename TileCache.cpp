@@ -0,0 +1,168 @@
+// TileCache.cpp
+
+#include "TileCache.h"
+
+static quint64 tileKey(int level, int tx, int ty)
+{
+    return ((quint64)level << 48) | ((quint64)ty << 24) | (quint64)tx;
+}
+
+TileCache::TileCache()
+{
+}
+
+TileCache::~TileCache()
+{
+}
+
+//
+// Drop all tiles
+//
+void TileCache::clear()
+{
+    m_tiles.clear();
+    m_key = 0;
+    m_size = QSize();
+}
+
+//
+// Drop tiles touched by an edit
+//     An empty dirty rect means the pixels are unchanged, pass the whole
+//     image when what changed isn't known. A new size drops everything.
+//
+void TileCache::invalidate(const QImage &img, QRect dirty)
+{
+    if (img.cacheKey() == m_key)
+        return;
+    if ((img.size() != m_size) || dirty.contains(img.rect()))
+        m_tiles.clear();
+    else if (!dirty.isEmpty())
+    {
+        auto it = m_tiles.begin();
+        while (it != m_tiles.end())
+        {
+            int level = it.key() >> 48;
+            int ty = (it.key() >> 24) & 0xFFFFFF;
+            int tx = it.key() & 0xFFFFFF;
+            if (tileRect(level, tx, ty, img).intersects(dirty))
+                it = m_tiles.erase(it);
+            else
+                ++it;
+        }
+    }
+    m_key = img.cacheKey();
+    m_size = img.size();
+}
+
+//
+// Replace colors of indexed images when drawn
+//
+void TileCache::setColors(const QVector<QRgb> &colors)
+{
+    if (colors == m_colors)
+        return;
+    m_colors = colors;
+    m_tiles.clear();
+}
+
+//
+// Draw the part of the image inside the exposed screen rectangle
+//     xform is applied after scaling, e.g. to show the page rotated
+//
+void TileCache::draw(QPainter &p, const QImage &img, qreal scale, const QRect &exposed, const QTransform &xform)
+{
+    // Visible part of the page
+    QTransform toScrn = QTransform::fromScale(scale, scale) * xform;
+    QRect area = toScrn.inverted().mapRect(exposed).adjusted(-1, -1, 1, 1) & img.rect();
+    if (area.isEmpty())
+        return;
+
+    // Smallest level that still has at least screen resolution
+    int level = 0;
+    while ((level < TILE_LEVELS) && (scale * (2 << level) <= 1.0))
+        level++;
+
+    p.save();
+    p.setTransform(toScrn);
+    if (level == 0)
+    {
+        if (m_colors.isEmpty())
+            p.drawImage(QRectF(area), img, QRectF(area));
+        else
+            p.drawImage(area.topLeft(), colored(img, area));
+    }
+    else
+    {
+        int span = TILE_SIZE << level;
+        for(int ty=area.top()/span; ty<=area.bottom()/span; ty++)
+            for(int tx=area.left()/span; tx<=area.right()/span; tx++)
+                p.drawImage(QRectF(tileRect(level, tx, ty, img)), tile(level, tx, ty, img));
+    }
+    p.restore();
+}
+
+//
+// Area of the page covered by a tile
+//
+QRect TileCache::tileRect(int level, int tx, int ty, const QImage &img)
+{
+    int span = TILE_SIZE << level;
+    return QRect(tx * span, ty * span, span, span) & img.rect();
+}
+
+//
+// Get a tile, building it from the level below if needed
+//
+QImage TileCache::tile(int level, int tx, int ty, const QImage &img)
+{
+    quint64 key = tileKey(level, tx, ty);
+    auto it = m_tiles.constFind(key);
+    if (it != m_tiles.constEnd())
+        return it.value();
+
+    QRect rect = tileRect(level, tx, ty, img);
+    if (rect.isEmpty())
+        return QImage();
+    QImage::Format format = (img.hasAlphaChannel() || !m_colors.isEmpty()) ?
+                    QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+
+    // Source at twice the resolution of this tile
+    QImage src;
+    if (level == 1)
+        src = colored(img, rect).convertToFormat(format);
+    else
+    {
+        int shift = level - 1;
+        src = QImage((rect.width() + (1 << shift) - 1) >> shift,
+                     (rect.height() + (1 << shift) - 1) >> shift, format);
+        src.fill(Qt::transparent);
+        QPainter p(&src);
+        p.setCompositionMode(QPainter::CompositionMode_Source);
+        for(int j=0; j<2; j++)
+            for(int i=0; i<2; i++)
+            {
+                QImage child = tile(level - 1, tx * 2 + i, ty * 2 + j, img);
+                if (!child.isNull())
+                    p.drawImage(QPoint(i * TILE_SIZE, j * TILE_SIZE), child);
+            }
+        p.end();
+    }
+
+    // Shrink by half
+    QSize size((rect.width() + (1 << level) - 1) >> level,
+               (rect.height() + (1 << level) - 1) >> level);
+    QImage result = src.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(format);
+    m_tiles.insert(key, result);
+    return result;
+}
+
+//
+// Copy part of the image, applying the color override
+//
+QImage TileCache::colored(const QImage &img, const QRect &rect)
+{
+    QImage part = img.copy(rect);
+    if (!m_colors.isEmpty() && (part.format() == QImage::Format_Indexed8))
+        part.setColorTable(m_colors);
+    return part;
+}
@@ -0,0 +1,46 @@
+// TileCache.h
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <QRect>
+#include <QVector>
+
+// Tile edge in pixels of its own level
+#define TILE_SIZE 256
+#define TILE_LEVELS 8
+
+//
+// Pyramid of downscaled tiles for drawing a page at low zoom
+//     Level n is the page shrunk by 2^n, level 0 is drawn straight
+//     from the page image so it is never stored
+//
+class TileCache
+{
+public:
+    TileCache();
+    ~TileCache();
+
+    // Methods
+    void clear();
+    void invalidate(const QImage &img, QRect dirty);
+    void setColors(const QVector<QRgb> &colors);
+    void draw(QPainter &p, const QImage &img, qreal scale, const QRect &exposed, const QTransform &xform = QTransform());
+
+private:
+    QRect tileRect(int level, int tx, int ty, const QImage &img);
+    QImage tile(int level, int tx, int ty, const QImage &img);
+    QImage colored(const QImage &img, const QRect &rect);
+
+    QHash<quint64, QImage> m_tiles;
+    qint64 m_key = 0;
+    QSize m_size;
+
+    // Color table override for indexed images such as masks
+    QVector<QRgb> m_colors;
+};
+
+#endif // TILECACHE_H
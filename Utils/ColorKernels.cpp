@@ -0,0 +1,394 @@
+#include "ColorKernels.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define KERNELS_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define KERNELS_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#endif
+
+//
+// Check once for AVX2 support
+//
+static bool useAVX2()
+{
+#ifdef KERNELS_AVX2
+    static bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+//
+// Scalar versions, also used for the leftover pixels at the end of a row
+//
+static inline int rgbDistance(QRgb val, int red, int grn, int blu)
+{
+    int max = abs(red - qRed(val));
+    int tmp = abs(grn - qGreen(val));
+    if (tmp > max)
+        max = tmp;
+    tmp = abs(blu - qBlue(val));
+    if (tmp > max)
+        max = tmp;
+    return max;
+}
+
+static void distanceRGB32Scalar(const QRgb *src, uchar *dist, int count, QRgb target)
+{
+    int red = qRed(target);
+    int grn = qGreen(target);
+    int blu = qBlue(target);
+    for(int idx=0; idx<count; idx++)
+        dist[idx] = rgbDistance(src[idx], red, grn, blu);
+}
+
+static void distanceGray8Scalar(const uchar *src, uchar *dist, int count, int target)
+{
+    for(int idx=0; idx<count; idx++)
+        dist[idx] = abs(target - src[idx]);
+}
+
+static inline int grayDistance(int red, int grn, int blu)
+{
+    return (grn - blu)*(grn - blu) + (blu - red)*(blu - red) + (red - grn)*(red - grn);
+}
+
+#ifdef KERNELS_SSE2
+//
+// Max channel distance of 4 pixels, result in the low byte of each dword
+//
+static inline __m128i rgbDistance4(__m128i px, __m128i target)
+{
+    const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+    __m128i diff = _mm_or_si128(_mm_subs_epu8(px, target), _mm_subs_epu8(target, px));
+    diff = _mm_and_si128(diff, rgbMask);
+    __m128i max = _mm_max_epu8(diff, _mm_srli_epi32(diff, 8));
+    max = _mm_max_epu8(max, _mm_srli_epi32(diff, 16));
+    return _mm_and_si128(max, _mm_set1_epi32(0xFF));
+}
+
+//
+// Distance of 16 pixels packed into bytes
+//
+static inline __m128i rgbDistance16(const QRgb *src, __m128i target)
+{
+    __m128i d0 = rgbDistance4(_mm_loadu_si128((const __m128i *)(src + 0)), target);
+    __m128i d1 = rgbDistance4(_mm_loadu_si128((const __m128i *)(src + 4)), target);
+    __m128i d2 = rgbDistance4(_mm_loadu_si128((const __m128i *)(src + 8)), target);
+    __m128i d3 = rgbDistance4(_mm_loadu_si128((const __m128i *)(src + 12)), target);
+    return _mm_packus_epi16(_mm_packs_epi32(d0, d1), _mm_packs_epi32(d2, d3));
+}
+
+static inline __m128i absDiff16(const uchar *src, __m128i target)
+{
+    __m128i px = _mm_loadu_si128((const __m128i *)src);
+    return _mm_or_si128(_mm_subs_epu8(px, target), _mm_subs_epu8(target, px));
+}
+
+static int distanceRGB32SSE2(const QRgb *src, uchar *dist, int count, QRgb target)
+{
+    __m128i tgt = _mm_set1_epi32(target);
+    int idx = 0;
+    for(; idx+16<=count; idx+=16)
+        _mm_storeu_si128((__m128i *)(dist + idx), rgbDistance16(src + idx, tgt));
+    return idx;
+}
+
+static int selectRGB32SSE2(const QRgb *src, uchar *mask, int count, QRgb target, int threshold)
+{
+    __m128i tgt = _mm_set1_epi32(target);
+    __m128i thr = _mm_set1_epi8((char)threshold);
+    __m128i one = _mm_set1_epi8(1);
+    int idx = 0;
+    for(; idx+16<=count; idx+=16)
+    {
+        __m128i dist = rgbDistance16(src + idx, tgt);
+        _mm_storeu_si128((__m128i *)(mask + idx), _mm_min_epu8(_mm_subs_epu8(dist, thr), one));
+    }
+    return idx;
+}
+
+//
+// Gray line test of 4 pixels, result is 1 or 0 in each dword
+//
+static inline __m128i grayLine4(__m128i px, __m128i limit)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    // Widen to 16 bits and difference each channel with the next one
+    __m128i lo = _mm_unpacklo_epi8(px, zero);
+    __m128i hi = _mm_unpackhi_epi8(px, zero);
+    __m128i loRot = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 0, 2, 1)), _MM_SHUFFLE(3, 0, 2, 1));
+    __m128i hiRot = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 0, 2, 1)), _MM_SHUFFLE(3, 0, 2, 1));
+    lo = _mm_sub_epi16(lo, loRot);
+    hi = _mm_sub_epi16(hi, hiRot);
+
+    // Sum of squares, per pixel in the low dword of each qword
+    lo = _mm_madd_epi16(lo, lo);
+    hi = _mm_madd_epi16(hi, hi);
+    lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+    hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+    __m128i sums = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+
+    return _mm_and_si128(_mm_cmplt_epi32(sums, limit), _mm_set1_epi32(1));
+}
+
+static int deColorRGB32SSE2(const QRgb *src, uchar *mask, int count, int limit)
+{
+    __m128i lim = _mm_set1_epi32(limit);
+    int idx = 0;
+    for(; idx+16<=count; idx+=16)
+    {
+        __m128i m0 = grayLine4(_mm_loadu_si128((const __m128i *)(src + idx + 0)), lim);
+        __m128i m1 = grayLine4(_mm_loadu_si128((const __m128i *)(src + idx + 4)), lim);
+        __m128i m2 = grayLine4(_mm_loadu_si128((const __m128i *)(src + idx + 8)), lim);
+        __m128i m3 = grayLine4(_mm_loadu_si128((const __m128i *)(src + idx + 12)), lim);
+        _mm_storeu_si128((__m128i *)(mask + idx), _mm_packus_epi16(_mm_packs_epi32(m0, m1), _mm_packs_epi32(m2, m3)));
+    }
+    return idx;
+}
+
+static int distanceGray8SSE2(const uchar *src, uchar *dist, int count, int target)
+{
+    __m128i tgt = _mm_set1_epi8((char)target);
+    int idx = 0;
+    for(; idx+16<=count; idx+=16)
+        _mm_storeu_si128((__m128i *)(dist + idx), absDiff16(src + idx, tgt));
+    return idx;
+}
+
+static int selectGray8SSE2(const uchar *src, uchar *mask, int count, int target, int threshold)
+{
+    __m128i tgt = _mm_set1_epi8((char)target);
+    __m128i thr = _mm_set1_epi8((char)threshold);
+    __m128i one = _mm_set1_epi8(1);
+    int idx = 0;
+    for(; idx+16<=count; idx+=16)
+    {
+        __m128i dist = absDiff16(src + idx, tgt);
+        _mm_storeu_si128((__m128i *)(mask + idx), _mm_min_epu8(_mm_subs_epu8(dist, thr), one));
+    }
+    return idx;
+}
+#endif
+
+#ifdef KERNELS_AVX2
+KERNELS_AVX2 static inline __m256i rgbDistance8(__m256i px, __m256i target)
+{
+    const __m256i rgbMask = _mm256_set1_epi32(0x00FFFFFF);
+    __m256i diff = _mm256_or_si256(_mm256_subs_epu8(px, target), _mm256_subs_epu8(target, px));
+    diff = _mm256_and_si256(diff, rgbMask);
+    __m256i max = _mm256_max_epu8(diff, _mm256_srli_epi32(diff, 8));
+    max = _mm256_max_epu8(max, _mm256_srli_epi32(diff, 16));
+    return _mm256_and_si256(max, _mm256_set1_epi32(0xFF));
+}
+
+//
+// Distance of 32 pixels packed into bytes
+//     The packs work within 128 bit lanes, so the dwords are put
+//     back in order at the end
+//
+KERNELS_AVX2 static inline __m256i rgbDistance32(const QRgb *src, __m256i target)
+{
+    __m256i d0 = rgbDistance8(_mm256_loadu_si256((const __m256i *)(src + 0)), target);
+    __m256i d1 = rgbDistance8(_mm256_loadu_si256((const __m256i *)(src + 8)), target);
+    __m256i d2 = rgbDistance8(_mm256_loadu_si256((const __m256i *)(src + 16)), target);
+    __m256i d3 = rgbDistance8(_mm256_loadu_si256((const __m256i *)(src + 24)), target);
+    __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(d0, d1), _mm256_packs_epi32(d2, d3));
+    return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+KERNELS_AVX2 static inline __m256i absDiff32(const uchar *src, __m256i target)
+{
+    __m256i px = _mm256_loadu_si256((const __m256i *)src);
+    return _mm256_or_si256(_mm256_subs_epu8(px, target), _mm256_subs_epu8(target, px));
+}
+
+KERNELS_AVX2 static int distanceRGB32AVX2(const QRgb *src, uchar *dist, int count, QRgb target)
+{
+    __m256i tgt = _mm256_set1_epi32(target);
+    int idx = 0;
+    for(; idx+32<=count; idx+=32)
+        _mm256_storeu_si256((__m256i *)(dist + idx), rgbDistance32(src + idx, tgt));
+    return idx;
+}
+
+KERNELS_AVX2 static int selectRGB32AVX2(const QRgb *src, uchar *mask, int count, QRgb target, int threshold)
+{
+    __m256i tgt = _mm256_set1_epi32(target);
+    __m256i thr = _mm256_set1_epi8((char)threshold);
+    __m256i one = _mm256_set1_epi8(1);
+    int idx = 0;
+    for(; idx+32<=count; idx+=32)
+    {
+        __m256i dist = rgbDistance32(src + idx, tgt);
+        _mm256_storeu_si256((__m256i *)(mask + idx), _mm256_min_epu8(_mm256_subs_epu8(dist, thr), one));
+    }
+    return idx;
+}
+
+KERNELS_AVX2 static inline __m256i grayLine8(__m256i px, __m256i limit)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    // Widen to 16 bits and difference each channel with the next one
+    __m256i lo = _mm256_unpacklo_epi8(px, zero);
+    __m256i hi = _mm256_unpackhi_epi8(px, zero);
+    __m256i loRot = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, _MM_SHUFFLE(3, 0, 2, 1)), _MM_SHUFFLE(3, 0, 2, 1));
+    __m256i hiRot = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, _MM_SHUFFLE(3, 0, 2, 1)), _MM_SHUFFLE(3, 0, 2, 1));
+    lo = _mm256_sub_epi16(lo, loRot);
+    hi = _mm256_sub_epi16(hi, hiRot);
+
+    // Sum of squares, the shuffle puts the pixels back in order per lane
+    lo = _mm256_madd_epi16(lo, lo);
+    hi = _mm256_madd_epi16(hi, hi);
+    lo = _mm256_add_epi32(lo, _mm256_srli_epi64(lo, 32));
+    hi = _mm256_add_epi32(hi, _mm256_srli_epi64(hi, 32));
+    __m256i sums = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(lo), _mm256_castsi256_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+
+    return _mm256_and_si256(_mm256_cmpgt_epi32(limit, sums), _mm256_set1_epi32(1));
+}
+
+KERNELS_AVX2 static int deColorRGB32AVX2(const QRgb *src, uchar *mask, int count, int limit)
+{
+    __m256i lim = _mm256_set1_epi32(limit);
+    int idx = 0;
+    for(; idx+32<=count; idx+=32)
+    {
+        __m256i m0 = grayLine8(_mm256_loadu_si256((const __m256i *)(src + idx + 0)), lim);
+        __m256i m1 = grayLine8(_mm256_loadu_si256((const __m256i *)(src + idx + 8)), lim);
+        __m256i m2 = grayLine8(_mm256_loadu_si256((const __m256i *)(src + idx + 16)), lim);
+        __m256i m3 = grayLine8(_mm256_loadu_si256((const __m256i *)(src + idx + 24)), lim);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(m0, m1), _mm256_packs_epi32(m2, m3));
+        _mm256_storeu_si256((__m256i *)(mask + idx), _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+    }
+    return idx;
+}
+
+KERNELS_AVX2 static int distanceGray8AVX2(const uchar *src, uchar *dist, int count, int target)
+{
+    __m256i tgt = _mm256_set1_epi8((char)target);
+    int idx = 0;
+    for(; idx+32<=count; idx+=32)
+        _mm256_storeu_si256((__m256i *)(dist + idx), absDiff32(src + idx, tgt));
+    return idx;
+}
+
+KERNELS_AVX2 static int selectGray8AVX2(const uchar *src, uchar *mask, int count, int target, int threshold)
+{
+    __m256i tgt = _mm256_set1_epi8((char)target);
+    __m256i thr = _mm256_set1_epi8((char)threshold);
+    __m256i one = _mm256_set1_epi8(1);
+    int idx = 0;
+    for(; idx+32<=count; idx+=32)
+    {
+        __m256i dist = absDiff32(src + idx, tgt);
+        _mm256_storeu_si256((__m256i *)(mask + idx), _mm256_min_epu8(_mm256_subs_epu8(dist, thr), one));
+    }
+    return idx;
+}
+#endif
+
+//
+// Distance from target color, max of the channel differences
+//
+void distanceRGB32(const QRgb *src, uchar *dist, int count, QRgb target)
+{
+    int idx = 0;
+#ifdef KERNELS_AVX2
+    if (useAVX2())
+        idx = distanceRGB32AVX2(src, dist, count, target);
+#endif
+#ifdef KERNELS_SSE2
+    idx += distanceRGB32SSE2(src + idx, dist + idx, count - idx, target);
+#endif
+    distanceRGB32Scalar(src + idx, dist + idx, count - idx, target);
+}
+
+void distanceGray8(const uchar *src, uchar *dist, int count, int target)
+{
+    int idx = 0;
+#ifdef KERNELS_AVX2
+    if (useAVX2())
+        idx = distanceGray8AVX2(src, dist, count, target);
+#endif
+#ifdef KERNELS_SSE2
+    idx += distanceGray8SSE2(src + idx, dist + idx, count - idx, target);
+#endif
+    distanceGray8Scalar(src + idx, dist + idx, count - idx, target);
+}
+
+//
+// Mask of pixels further than threshold from the target color
+//
+void selectRGB32(const QRgb *src, uchar *mask, int count, QRgb target, int threshold)
+{
+    if ((threshold < 0) || (threshold >= 255))
+    {
+        memset(mask, (threshold < 0) ? 1 : 0, count);
+        return;
+    }
+
+    int idx = 0;
+#ifdef KERNELS_AVX2
+    if (useAVX2())
+        idx = selectRGB32AVX2(src, mask, count, target, threshold);
+#endif
+#ifdef KERNELS_SSE2
+    idx += selectRGB32SSE2(src + idx, mask + idx, count - idx, target, threshold);
+#endif
+    int red = qRed(target);
+    int grn = qGreen(target);
+    int blu = qBlue(target);
+    for(; idx<count; idx++)
+        mask[idx] = (rgbDistance(src[idx], red, grn, blu) > threshold) ? 1 : 0;
+}
+
+void selectGray8(const uchar *src, uchar *mask, int count, int target, int threshold)
+{
+    if ((threshold < 0) || (threshold >= 255))
+    {
+        memset(mask, (threshold < 0) ? 1 : 0, count);
+        return;
+    }
+
+    int idx = 0;
+#ifdef KERNELS_AVX2
+    if (useAVX2())
+        idx = selectGray8AVX2(src, mask, count, target, threshold);
+#endif
+#ifdef KERNELS_SSE2
+    idx += selectGray8SSE2(src + idx, mask + idx, count - idx, target, threshold);
+#endif
+    for(; idx<count; idx++)
+        mask[idx] = (abs(target - src[idx]) > threshold) ? 1 : 0;
+}
+
+//
+// Mark pixels near the gray line with 1, colorful ones with 0
+//
+void deColorRGB32(const QRgb *src, uchar *mask, int count, int limit)
+{
+    int idx = 0;
+#ifdef KERNELS_AVX2
+    if (useAVX2())
+        idx = deColorRGB32AVX2(src, mask, count, limit);
+#endif
+#ifdef KERNELS_SSE2
+    idx += deColorRGB32SSE2(src + idx, mask + idx, count - idx, limit);
+#endif
+    for(; idx<count; idx++)
+        mask[idx] = (grayDistance(qRed(src[idx]), qGreen(src[idx]), qBlue(src[idx])) < limit) ? 1 : 0;
+}
+
+void deColorRGB888(const uchar *src, uchar *mask, int count, int limit)
+{
+    for(int idx=0; idx<count; idx++, src+=3)
+        mask[idx] = (grayDistance(src[0], src[1], src[2]) < limit) ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+// ColorKernels.h
+
+#ifndef COLORKERNELS_H
+#define COLORKERNELS_H
+
+#include <QImage>
+
+//
+// Scanline kernels for color selection
+//     SSE2 or AVX2 versions are picked at runtime, with a scalar
+//     fallback for other processors. Mask bytes are 0 when the pixel
+//     is within threshold and 1 otherwise, as used by Page masks.
+//
+void selectRGB32(const QRgb *src, uchar *mask, int count, QRgb target, int threshold);
+void selectGray8(const uchar *src, uchar *mask, int count, int target, int threshold);
+void distanceRGB32(const QRgb *src, uchar *dist, int count, QRgb target);
+void distanceGray8(const uchar *src, uchar *dist, int count, int target);
+
+//
+// Mask of colorful pixels for deColor
+//     limit is compared against the squared distance from the gray
+//     line times 3, (g-b)^2 + (b-r)^2 + (r-g)^2
+//
+void deColorRGB32(const QRgb *src, uchar *mask, int count, int limit);
+void deColorRGB888(const uchar *src, uchar *mask, int count, int limit);
+#endif
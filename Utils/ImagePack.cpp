@@ -0,0 +1,273 @@
+#include "ImagePack.h"
+#include <QDataStream>
+#include <QMap>
+#include <QThread>
+#include <QThreadPool>
+#include <QWeakPointer>
+
+//
+// PackBits run length coding, works well on bilevel scans
+//
+static QByteArray packBits(const uchar *src, qint64 len)
+{
+    QByteArray out;
+    out.reserve(len / 8);
+    qint64 idx = 0;
+    while (idx < len)
+    {
+        // Repeated bytes
+        int run = 1;
+        while ((idx + run < len) && (run < 128) && (src[idx + run] == src[idx]))
+            run++;
+        if (run > 1)
+        {
+            out.append(char(1 - run));
+            out.append(char(src[idx]));
+            idx += run;
+            continue;
+        }
+
+        // Literal bytes up to the next repeat
+        int lit = 1;
+        while ((idx + lit < len) && (lit < 128) &&
+               !((idx + lit + 1 < len) && (src[idx + lit] == src[idx + lit + 1])))
+            lit++;
+        out.append(char(lit - 1));
+        out.append((const char *)src + idx, lit);
+        idx += lit;
+    }
+    return out;
+}
+
+static bool unpackBits(const QByteArray &in, uchar *dst, qint64 len)
+{
+    const uchar *ptr = (const uchar *)in.constData();
+    const uchar *end = ptr + in.size();
+    qint64 idx = 0;
+    while (ptr < end)
+    {
+        int code = (signed char)*ptr++;
+        if (code >= 0)
+        {
+            if ((end - ptr < code + 1) || (idx + code + 1 > len))
+                return false;
+            memcpy(dst + idx, ptr, code + 1);
+            ptr += code + 1;
+            idx += code + 1;
+        }
+        else if (code != -128)
+        {
+            if ((ptr >= end) || (idx + 1 - code > len))
+                return false;
+            memset(dst + idx, *ptr++, 1 - code);
+            idx += 1 - code;
+        }
+    }
+    return (idx == len);
+}
+
+//
+// Bilevel images are run length coded, everything else gets zlib
+//
+static bool isBilevel(QImage::Format fmt)
+{
+    return (fmt == QImage::Format_Mono) || (fmt == QImage::Format_MonoLSB);
+}
+
+//
+// Serialize an image into a compact byte array
+//     Pixels are run length coded or zlib compressed at the fastest
+//     level, color table and metadata are kept so the image comes
+//     back identical
+//
+QByteArray packImage(const QImage &img)
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+
+    out << (qint32)img.format();
+    if (img.isNull())
+        return data;
+
+    // Geometry and metadata
+    out << (qint32)img.width() << (qint32)img.height();
+    out << (qint32)img.dotsPerMeterX() << (qint32)img.dotsPerMeterY();
+    out << img.colorTable();
+    QMap<QString, QString> text;
+    for (const auto& key : img.textKeys())
+        text.insert(key, img.text(key));
+    out << text;
+
+    // Pixels
+    if (isBilevel(img.format()))
+        out << packBits(img.constBits(), img.sizeInBytes());
+    else
+        out << qCompress(img.constBits(), img.sizeInBytes(), 1);
+    return data;
+}
+
+//
+// Rebuild an image from packImage output
+//
+QImage unpackImage(const QByteArray &data)
+{
+    QDataStream in(data);
+    qint32 fmt, width, height, dpmX, dpmY;
+
+    in >> fmt;
+    if (fmt == QImage::Format_Invalid)
+        return QImage();
+
+    // Geometry and metadata
+    in >> width >> height >> dpmX >> dpmY;
+    QVector<QRgb> colors;
+    in >> colors;
+    QMap<QString, QString> text;
+    in >> text;
+
+    // Pixels
+    QByteArray bits;
+    in >> bits;
+    if (in.status() != QDataStream::Ok)
+        return QImage();
+
+    QImage img(width, height, (QImage::Format)fmt);
+    if (img.isNull())
+        return QImage();
+    if (isBilevel(img.format()))
+    {
+        if (!unpackBits(bits, img.bits(), img.sizeInBytes()))
+            return QImage();
+    }
+    else
+    {
+        bits = qUncompress(bits);
+        if (bits.size() != img.sizeInBytes())
+            return QImage();
+        memcpy(img.bits(), bits.constData(), bits.size());
+    }
+    img.setColorTable(colors);
+    img.setDotsPerMeterX(dpmX);
+    img.setDotsPerMeterY(dpmY);
+    for (auto it = text.constBegin(); it != text.constEnd(); ++it)
+        img.setText(it.key(), it.value());
+    return img;
+}
+
+PackedImage::PackedImage()
+{
+}
+
+PackedImage::PackedImage(const QImage &img)
+{
+    if (img.isNull())
+        return;
+    d.reset(new Data);
+    d->img = img;
+}
+
+PackedImage PackedImage::fromPacked(const QByteArray &data)
+{
+    PackedImage packed;
+    packed.d.reset(new Data);
+    packed.d->packed = data;
+    return packed;
+}
+
+bool PackedImage::isNull() const
+{
+    return d.isNull();
+}
+
+//
+// Get the image, decompressing if needed
+//
+QImage PackedImage::image() const
+{
+    if (d.isNull())
+        return QImage();
+    QMutexLocker locker(&d->mutex);
+    if (!d->img.isNull())
+        return d->img;
+    return unpackImage(d->packed);
+}
+
+//
+// Get the compressed form, packing now if the background job hasn't
+//
+QByteArray PackedImage::packed() const
+{
+    if (d.isNull())
+        return packImage(QImage());
+    QMutexLocker locker(&d->mutex);
+    if (!d->packed.isEmpty())
+        return d->packed;
+    return packImage(d->img);
+}
+
+//
+// Memory currently held
+//
+qint64 PackedImage::sizeInBytes() const
+{
+    if (d.isNull())
+        return 0;
+    QMutexLocker locker(&d->mutex);
+    if (!d->img.isNull())
+        return d->img.sizeInBytes();
+    return d->packed.size();
+}
+
+//
+// Pool for compression jobs
+//     Kept apart from the global pool, which batch operations fill
+//     for as long as they run
+//
+class PackPool : public QThreadPool
+{
+public:
+    PackPool()
+    {
+        setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+    }
+};
+
+//
+// Compress in the background at low priority
+//     The job only holds a weak reference, steps dropped from the
+//     history before it runs are skipped. The image is counted at full
+//     size until the packed copy replaces it.
+//
+void PackedImage::compress()
+{
+    if (d.isNull())
+        return;
+    QMutexLocker locker(&d->mutex);
+    if (d->busy || d->img.isNull())
+        return;
+    d->busy = true;
+
+    static PackPool pool;
+    QWeakPointer<Data> weak = d;
+    pool.start([weak]() {
+        QImage img;
+        {
+            QSharedPointer<Data> data = weak.toStrongRef();
+            if (data.isNull())
+                return;
+            QMutexLocker locker(&data->mutex);
+            img = data->img;
+        }
+
+        QThread::currentThread()->setPriority(QThread::LowPriority);
+        QByteArray packed = packImage(img);
+
+        QSharedPointer<Data> data = weak.toStrongRef();
+        if (data.isNull())
+            return;
+        QMutexLocker locker(&data->mutex);
+        data->packed = packed;
+        data->img = QImage();
+        data->busy = false;
+    });
+}
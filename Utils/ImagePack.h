@@ -0,0 +1,41 @@
+// ImagePack.h
+
+#ifndef IMAGEPACK_H
+#define IMAGEPACK_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QMutex>
+#include <QSharedPointer>
+
+QByteArray packImage(const QImage &img);
+QImage unpackImage(const QByteArray &data);
+
+//
+// Image that can be compressed in the background
+//     Copies share the same data, so compressing one compresses all
+//
+class PackedImage
+{
+public:
+    PackedImage();
+    PackedImage(const QImage &img);
+    static PackedImage fromPacked(const QByteArray &data);
+
+    bool isNull() const;
+    QImage image() const;
+    QByteArray packed() const;
+    qint64 sizeInBytes() const;
+    void compress();
+
+private:
+    struct Data
+    {
+        QMutex mutex;
+        QImage img;
+        QByteArray packed;
+        bool busy = false;
+    };
+    QSharedPointer<Data> d;
+};
+#endif
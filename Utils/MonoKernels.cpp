@@ -0,0 +1,597 @@
+#include "MonoKernels.h"
+#include <QtAlgorithms>
+#include <QtEndian>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+static const quint64 ALL_ONES = ~Q_UINT64_C(0);
+
+// Sweeps scoring below this best to worst ratio are left level
+static const double MIN_SKEW_CONF = 3.0;
+
+//
+// Image unpacked into 64 bit words, one bit per pixel
+//     Pixel x of a row is bit 63 - x % 64 of word x / 64, and is set
+//     when the pixel has the requested value. Bits past the right edge
+//     are always clear.
+//
+struct BitPlane
+{
+    BitPlane(int w, int h) : width(w), height(h), words((w + 63) >> 6), bits(size_t(words) * h, 0) {}
+    quint64 *row(int y) { return bits.data() + size_t(y) * words; }
+    const quint64 *row(int y) const { return bits.data() + size_t(y) * words; }
+
+    int width;
+    int height;
+    int words;
+    std::vector<quint64> bits;
+};
+
+//
+// Unpack one Format_Mono scanline
+//
+static void loadRow(const uchar *src, int width, int value, quint64 *dst)
+{
+    int words = (width + 63) >> 6;
+    int bytes = (width + 7) >> 3;
+    quint64 flip = value ? 0 : ALL_ONES;
+    for(int w=0; w<words; w++)
+    {
+        quint64 word;
+        if ((w + 1) * 8 <= bytes)
+            word = qFromBigEndian<quint64>(src + w * 8);
+        else
+        {
+            // Scanlines are only padded to 32 bits
+            uchar tmp[8] = {0};
+            memcpy(tmp, src + w * 8, bytes - w * 8);
+            word = qFromBigEndian<quint64>(tmp);
+        }
+        dst[w] = word ^ flip;
+    }
+    if (width & 63)
+        dst[words - 1] &= ALL_ONES << (64 - (width & 63));
+}
+
+static BitPlane loadPlane(const QImage &img, int value)
+{
+    BitPlane plane(img.width(), img.height());
+    for(int y=0; y<img.height(); y++)
+        loadRow(img.constScanLine(y), img.width(), value, plane.row(y));
+    return plane;
+}
+
+//
+// First set bit in [from, to), or to if there is none
+//     fetch returns word w of the row, letting callers combine planes
+//
+template <typename Fetch>
+static inline int findBit(Fetch fetch, int from, int to)
+{
+    if (from >= to)
+        return to;
+    int w = from >> 6;
+    int last = (to - 1) >> 6;
+    quint64 word = fetch(w) & (ALL_ONES >> (from & 63));
+    while (word == 0)
+    {
+        if (++w > last)
+            return to;
+        word = fetch(w);
+    }
+    return std::min((w << 6) + int(qCountLeadingZeroBits(word)), to);
+}
+
+//
+// Last set bit at or before from, or -1 if there is none
+//
+template <typename Fetch>
+static inline int findBitBack(Fetch fetch, int from)
+{
+    if (from < 0)
+        return -1;
+    int w = from >> 6;
+    quint64 word = fetch(w) & (ALL_ONES << (63 - (from & 63)));
+    while (word == 0)
+    {
+        if (--w < 0)
+            return -1;
+        word = fetch(w);
+    }
+    return (w << 6) + 63 - int(qCountTrailingZeroBits(word));
+}
+
+static inline int nextSet(const quint64 *row, int from, int to)
+{
+    return findBit([row](int w) { return row[w]; }, from, to);
+}
+
+static inline int nextClear(const quint64 *row, int from, int to)
+{
+    return findBit([row](int w) { return ~row[w]; }, from, to);
+}
+
+//
+// Bits of word w that fall inside [from, to)
+//
+static inline quint64 rangeMask(int w, int from, int to)
+{
+    quint64 mask = ALL_ONES;
+    if ((from >> 6) == w)
+        mask &= ALL_ONES >> (from & 63);
+    if (((to - 1) >> 6) == w)
+        mask &= ALL_ONES << (63 - ((to - 1) & 63));
+    return mask;
+}
+
+static inline int countRange(const quint64 *row, int from, int to)
+{
+    int cnt = 0;
+    for(int w=from >> 6; w<=((to - 1) >> 6); w++)
+        cnt += qPopulationCount(row[w] & rangeMask(w, from, to));
+    return cnt;
+}
+
+static inline void setRange(quint64 *row, int from, int to)
+{
+    for(int w=from >> 6; w<=((to - 1) >> 6); w++)
+        row[w] |= rangeMask(w, from, to);
+}
+
+//
+// Bit value of the black pixels
+//
+int monoInk(const QImage &img)
+{
+    if (img.colorCount() < 2)
+        return 1;
+    return (qGray(img.color(1)) < qGray(img.color(0))) ? 1 : 0;
+}
+
+//
+// Expand each pixel into a byte of dst, zero or one by its value
+//     dst is an 8 bit image of the same size
+//
+void monoExpand(const QImage &img, QImage &dst, uchar zero, uchar one)
+{
+    // Eight output bytes for every possible input byte
+    uchar table[256][8];
+    for(int val=0; val<256; val++)
+        for(int bit=0; bit<8; bit++)
+            table[val][bit] = (val & (0x80 >> bit)) ? one : zero;
+
+    int whole = img.width() >> 3;
+    for(int y=0; y<img.height(); y++)
+    {
+        const uchar *src = img.constScanLine(y);
+        uchar *out = dst.scanLine(y);
+        for(int idx=0; idx<whole; idx++)
+            memcpy(out + idx * 8, table[src[idx]], 8);
+        for(int x=whole * 8; x<img.width(); x++)
+            out[x] = table[src[whole]][x & 7];
+    }
+}
+
+//
+// Bounding box of the pixels with the given value
+//
+QRect monoBoundingRect(const QImage &img, int value)
+{
+    std::vector<quint64> row((img.width() + 63) >> 6);
+    int top = img.height(), bottom = -1;
+    int left = img.width(), right = -1;
+    for(int y=0; y<img.height(); y++)
+    {
+        loadRow(img.constScanLine(y), img.width(), value, row.data());
+        int first = nextSet(row.data(), 0, img.width());
+        if (first >= img.width())
+            continue;
+        const quint64 *ptr = row.data();
+        int last = findBitBack([ptr](int w) { return ptr[w]; }, img.width() - 1);
+        top = std::min(top, y);
+        bottom = y;
+        left = std::min(left, first);
+        right = std::max(right, last);
+    }
+    if (bottom < 0)
+        return QRect();
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+//
+// Label the connected pixels with the given value
+//     Runs are found a word at a time and joined to the runs they
+//     touch in the row above with a union-find, so the work grows with
+//     the number of runs rather than pixels.
+//
+static int findRoot(std::vector<int> &parent, int idx)
+{
+    while (parent[idx] != idx)
+    {
+        parent[idx] = parent[parent[idx]];
+        idx = parent[idx];
+    }
+    return idx;
+}
+
+MonoBlobs monoComponents(const QImage &img, int value, bool eight)
+{
+    MonoBlobs blobs;
+    std::vector<int> parent;
+    std::vector<quint64> row((img.width() + 63) >> 6);
+    int width = img.width();
+    int prevStart = 0, prevEnd = 0;
+
+    for(int y=0; y<img.height(); y++)
+    {
+        loadRow(img.constScanLine(y), width, value, row.data());
+        int curStart = blobs.runs.size();
+        int prev = prevStart;
+        int x = 0;
+        while ((x = nextSet(row.data(), x, width)) < width)
+        {
+            int end = nextClear(row.data(), x, width);
+            int idx = blobs.runs.size();
+            blobs.runs.append({ y, x, end, idx });
+            parent.push_back(idx);
+
+            // Join runs above that overlap, or touch diagonally for 8-way
+            int lo = eight ? x - 1 : x;
+            int hi = eight ? end + 1 : end;
+            while ((prev < prevEnd) && (blobs.runs[prev].end <= lo))
+                prev++;
+            for(int above=prev; (above < prevEnd) && (blobs.runs[above].start < hi); above++)
+            {
+                int a = findRoot(parent, above);
+                int b = findRoot(parent, idx);
+                if (a < b)
+                    parent[b] = a;
+                else if (b < a)
+                    parent[a] = b;
+            }
+            x = end;
+        }
+        prevStart = curStart;
+        prevEnd = blobs.runs.size();
+    }
+
+    // Number the components in raster order and gather their stats
+    for(int idx=0; idx<blobs.runs.size(); idx++)
+    {
+        MonoRun &run = blobs.runs[idx];
+        int root = findRoot(parent, idx);
+        QRect span(QPoint(run.start, run.row), QPoint(run.end - 1, run.row));
+        if (root == idx)
+        {
+            run.label = blobs.area.size();
+            blobs.area.append(run.end - run.start);
+            blobs.bounds.append(span);
+        }
+        else
+        {
+            run.label = blobs.runs[root].label;
+            blobs.area[run.label] += run.end - run.start;
+            blobs.bounds[run.label] |= span;
+        }
+    }
+    return blobs;
+}
+
+//
+// Clear mask bytes under the pixels 8-way connected to seed that
+// share its value
+//     Spans are filled a row at a time, looking above and below for
+//     matching pixels not yet filled.
+//
+void monoFloodFill(const QImage &img, QPoint seed, QImage &mask)
+{
+    int width = img.width();
+    BitPlane match = loadPlane(img, img.pixelIndex(seed));
+    BitPlane filled(width, img.height());
+
+    QVector<QPoint> stack;
+    stack.append(seed);
+    while (!stack.isEmpty())
+    {
+        QPoint pt = stack.takeLast();
+        const quint64 *row = match.row(pt.y());
+        quint64 *done = filled.row(pt.y());
+        if (done[pt.x() >> 6] & (Q_UINT64_C(1) << (63 - (pt.x() & 63))))
+            continue;
+
+        // Widen to the whole span of matching pixels
+        int left = findBitBack([row](int w) { return ~row[w]; }, pt.x()) + 1;
+        int right = nextClear(row, pt.x(), width);
+        setRange(done, left, right);
+
+        // Queue a pixel of each unfilled span touching this one
+        for(int y=pt.y() - 1; y<=pt.y() + 1; y+=2)
+        {
+            if ((y < 0) || (y >= img.height()))
+                continue;
+            const quint64 *next = match.row(y);
+            const quint64 *nextDone = filled.row(y);
+            auto open = [next, nextDone](int w) { return next[w] & ~nextDone[w]; };
+            auto closed = [next, nextDone](int w) { return ~(next[w] & ~nextDone[w]); };
+            int to = std::min(right + 1, width);
+            int x = std::max(left - 1, 0);
+            while ((x = findBit(open, x, to)) < to)
+            {
+                stack.append(QPoint(x, y));
+                x = findBit(closed, x, to);
+            }
+        }
+    }
+
+    // Copy the filled spans into the mask
+    for(int y=0; y<img.height(); y++)
+    {
+        const quint64 *row = filled.row(y);
+        uchar *maskPtr = mask.scanLine(y);
+        int x = 0;
+        while ((x = nextSet(row, x, width)) < width)
+        {
+            int end = nextClear(row, x, width);
+            memset(maskPtr + x, 0, end - x);
+            x = end;
+        }
+    }
+}
+
+//
+// Sharpness of the horizontal projection after a vertical shear
+//     Pixel (x,y) is counted in line y + x * tan(angle). Columns that
+//     share a shift are summed with popcount, and the score is the sum
+//     of squared differences between neighboring lines, which peaks
+//     when text lines are level.
+//
+static double projectionScore(const BitPlane &plane, float angle, std::vector<int> &lines)
+{
+    double slope = tan(angle * M_PI / 180.0);
+    double step = fabs(slope);
+    int span = int(lround(step * plane.width)) + 1;
+    lines.assign(plane.height + span * 2, 0);
+
+    // Columns [cols[k], cols[k+1]) all shift by k
+    std::vector<int> cols;
+    cols.push_back(0);
+    for(int k=0; (step > 0) && (cols.back() < plane.width); k++)
+        cols.push_back(std::min(int(ceil((k + 0.5) / step)), plane.width));
+    if (cols.back() < plane.width)
+        cols.push_back(plane.width);
+
+    for(int y=0; y<plane.height; y++)
+    {
+        const quint64 *row = plane.row(y);
+        for(size_t k=0; k+1<cols.size(); k++)
+        {
+            if (cols[k] >= cols[k + 1])
+                continue;
+            int cnt = countRange(row, cols[k], cols[k + 1]);
+            if (cnt)
+                lines[y + span + ((slope < 0) ? -int(k) : int(k))] += cnt;
+        }
+    }
+
+    double score = 0;
+    for(size_t idx=1; idx<lines.size(); idx++)
+    {
+        double diff = lines[idx] - lines[idx - 1];
+        score += diff * diff;
+    }
+    return score;
+}
+
+//
+// Halve a plane in both directions, a pixel is set if any of the four
+// it covers is set
+//
+static inline quint64 compactEven(quint64 x)
+{
+    // Gather bits 0, 2, 4 ... 62 into the low 32 bits
+    x &= Q_UINT64_C(0x5555555555555555);
+    x = (x | (x >> 1)) & Q_UINT64_C(0x3333333333333333);
+    x = (x | (x >> 2)) & Q_UINT64_C(0x0F0F0F0F0F0F0F0F);
+    x = (x | (x >> 4)) & Q_UINT64_C(0x00FF00FF00FF00FF);
+    x = (x | (x >> 8)) & Q_UINT64_C(0x0000FFFF0000FFFF);
+    x = (x | (x >> 16)) & Q_UINT64_C(0x00000000FFFFFFFF);
+    return x;
+}
+
+static BitPlane reducePlane(const BitPlane &src)
+{
+    BitPlane dst((src.width + 1) / 2, (src.height + 1) / 2);
+    for(int y=0; y<dst.height; y++)
+    {
+        const quint64 *top = src.row(y * 2);
+        const quint64 *bot = (y * 2 + 1 < src.height) ? src.row(y * 2 + 1) : top;
+        quint64 *out = dst.row(y);
+        for(int w=0; w<src.words; w++)
+        {
+            quint64 word = top[w] | bot[w];
+            word |= word << 1;
+            quint64 half = compactEven(word >> 1);
+            out[w >> 1] |= (w & 1) ? half : (half << 32);
+        }
+    }
+    return dst;
+}
+
+//
+// Copy rect out of a plane
+//
+static BitPlane cropPlane(const BitPlane &src, QRect rect)
+{
+    BitPlane dst(rect.width(), rect.height());
+    for(int y=0; y<dst.height; y++)
+    {
+        const quint64 *in = src.row(rect.top() + y);
+        quint64 *out = dst.row(y);
+        for(int k=0; k<dst.words; k++)
+        {
+            int offset = rect.left() + k * 64;
+            int w = offset >> 6;
+            int shift = offset & 63;
+            quint64 word = in[w] << shift;
+            if (shift && (w + 1 < src.words))
+                word |= in[w + 1] >> (64 - shift);
+            out[k] = word;
+        }
+        if (dst.width & 63)
+            out[dst.words - 1] &= ALL_ONES << (64 - (dst.width & 63));
+    }
+    return dst;
+}
+
+//
+// Area holding text
+//     Rows and columns count as text when between 1% and half of their
+//     pixels are set, which leaves out blank margins, specks and the
+//     dark borders scanners leave around a page. Empty when no row or
+//     column qualifies.
+//
+static QRect textRegion(const BitPlane &plane)
+{
+    std::vector<int> cols(plane.width, 0);
+    int top = plane.height, bottom = -1;
+    for(int y=0; y<plane.height; y++)
+    {
+        const quint64 *row = plane.row(y);
+        int cnt = countRange(row, 0, plane.width);
+        if ((cnt * 100 > plane.width) && (cnt * 2 < plane.width))
+        {
+            top = std::min(top, y);
+            bottom = y;
+        }
+
+        for(int w=0; w<plane.words; w++)
+        {
+            quint64 word = row[w];
+            while (word)
+            {
+                int bit = qCountLeadingZeroBits(word);
+                cols[(w << 6) + bit]++;
+                word &= ~(Q_UINT64_C(1) << (63 - bit));
+            }
+        }
+    }
+
+    int left = plane.width, right = -1;
+    for(int x=0; x<plane.width; x++)
+    {
+        if ((cols[x] * 100 > plane.height) && (cols[x] * 2 < plane.height))
+        {
+            left = std::min(left, x);
+            right = x;
+        }
+    }
+
+    if ((bottom < 0) || (right < 0))
+        return QRect();
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+//
+// Ties go to the angle closest to level
+//
+static bool betterSkew(double score, float angle, double maxScore, float best)
+{
+    return (score > maxScore) || ((score == maxScore) && (fabs(angle) < fabs(best)));
+}
+
+//
+// Halve the step around the best angle until it drops below limit
+//
+static float searchSkew(const BitPlane &plane, float best, float delta, float limit, std::vector<int> &lines)
+{
+    double maxScore = projectionScore(plane, best, lines);
+    for(; delta>=limit; delta/=2)
+    {
+        float center = best;
+        for(float angle : { center - delta, center + delta })
+        {
+            double score = projectionScore(plane, angle, lines);
+            if (betterSkew(score, angle, maxScore, best))
+            {
+                maxScore = score;
+                best = angle;
+            }
+        }
+    }
+    return best;
+}
+
+//
+// Find the rotation in degrees that levels the text lines
+//     The search starts on a copy reduced 4x: a sweep of +/-7 degrees a
+//     degree at a time, then halving the step down to 0.1 degrees. The
+//     last steps down to 0.01 degrees are made on the full resolution
+//     plane. With textOnly only the text region is looked at.
+//     Confidence is the ratio of the best sweep score to the worst.
+//     Pages without ink or text, or where the sweep is not confident,
+//     are left level.
+//
+float monoFindSkew(const QImage &img, int value, bool textOnly, float *conf)
+{
+    BitPlane full = loadPlane(img, value);
+    BitPlane reduced = reducePlane(reducePlane(full));
+    if ((reduced.width < 2) || (reduced.height < 2))
+    {
+        if (conf != nullptr)
+            *conf = 0.0;
+        return 0.0;
+    }
+
+    // Limit both planes to the text
+    if (textOnly)
+    {
+        QRect region = textRegion(reduced);
+        if (region.isEmpty())
+        {
+            if (conf != nullptr)
+                *conf = 0.0;
+            return 0.0;
+        }
+        reduced = cropPlane(reduced, region);
+        QRect scaled(region.left() * 4, region.top() * 4, region.width() * 4, region.height() * 4);
+        full = cropPlane(full, scaled & QRect(0, 0, full.width, full.height));
+    }
+
+    // Nothing to level on a blank page
+    bool blank = true;
+    for(int y=0; blank && (y<reduced.height); y++)
+        blank = (countRange(reduced.row(y), 0, reduced.width) == 0);
+    if (blank)
+    {
+        if (conf != nullptr)
+            *conf = 0.0;
+        return 0.0;
+    }
+
+    // Coarse sweep
+    std::vector<int> lines;
+    float best = 0.0;
+    double maxScore = -1.0, minScore = -1.0;
+    for(float angle=-7.0; angle<=7.0; angle+=1.0)
+    {
+        double score = projectionScore(reduced, angle, lines);
+        if (betterSkew(score, angle, maxScore, best))
+        {
+            maxScore = score;
+            best = angle;
+        }
+        if ((minScore < 0) || (score < minScore))
+            minScore = score;
+    }
+    double ratio = (minScore > 0) ? (maxScore / minScore) : 0.0;
+    if (conf != nullptr)
+        *conf = float(ratio);
+    if ((maxScore <= minScore) || ((minScore > 0) && (ratio < MIN_SKEW_CONF)))
+        return 0.0;
+
+    // Refine, first reduced then full size
+    best = searchSkew(reduced, best, 0.5, 0.1, lines);
+    return searchSkew(full, best, 0.0625, 0.01, lines);
+}
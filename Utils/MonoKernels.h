@@ -0,0 +1,42 @@
+// MonoKernels.h
+
+#ifndef MONOKERNELS_H
+#define MONOKERNELS_H
+
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+
+//
+// Packed bit operations on Format_Mono images
+//     Scanlines are worked on 64 pixels at a time without converting
+//     to 8 bits. value is the bit value of the pixels of interest, see
+//     monoInk for the value of black.
+//
+
+// Horizontal run of pixels, end is exclusive
+struct MonoRun
+{
+    int row;
+    int start;
+    int end;
+    int label;
+};
+
+// Connected components of a bilevel image, labels start at 0
+struct MonoBlobs
+{
+    QVector<MonoRun> runs;      // In raster order
+    QVector<int> area;          // Pixel count of each label
+    QVector<QRect> bounds;      // Bounding box of each label
+    int count() const { return area.size(); }
+};
+
+int monoInk(const QImage &img);
+void monoExpand(const QImage &img, QImage &dst, uchar zero, uchar one);
+QRect monoBoundingRect(const QImage &img, int value);
+MonoBlobs monoComponents(const QImage &img, int value, bool eight = false);
+void monoFloodFill(const QImage &img, QPoint seed, QImage &mask);
+float monoFindSkew(const QImage &img, int value, bool textOnly = false, float *conf = nullptr);
+#endif
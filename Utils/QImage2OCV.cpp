@@ -1,69 +1,131 @@
 #include "QImage2OCV.h"
 
 //
-// Create a openCV matrix from a qimage
-//      Works for color and grayscale
+// Matrix type matching a QImage format, -1 if not handled
 //
-cv::Mat QImage2OCV(QImage &img)
+static int matType(const QImage &img)
 {
-    int fmt;
-
-    if (img.isNull())
-        return cv::Mat();
-
-    // Pick destination format
     switch (img.format())
     {
         case QImage::Format_Grayscale8:
-            fmt = CV_8UC1;
-            break;
+            return CV_8UC1;
         case QImage::Format_RGB888:
-            fmt = CV_8UC3;
-            break;
+            return CV_8UC3;
         case QImage::Format_RGB32:
         case QImage::Format_ARGB32:
-            fmt = CV_8UC4;
-            break;
+            return CV_8UC4;
         default:
             qWarning() << "QImage2OCV: QImage type not handled in switch: " << img.format();
-            return cv::Mat();
+            return -1;
     }
-
-    // Convert to matrix
-    cv::Mat mat(img.height(), img.width(), fmt, img.bits(), img.bytesPerLine());
-    if (fmt == CV_8UC3)
-        cv::cvtColor(mat, mat, CV_RGB2BGR);
-    return mat.clone();
 }
 
 //
-// Create a QImage from a openCV matrix
-//      Works for color and grayscale
+// QImage format matching a matrix type, Format_Invalid if not handled
 //
-QImage OCV2QImage(cv::Mat &mat)
+static QImage::Format imageFormat(const cv::Mat &mat)
 {
-    QImage::Format fmt;
-
-    // Pick destination format
     switch (mat.type())
     {
         case CV_8UC4:
-            fmt = QImage::Format_ARGB32;
-            break;
+            return QImage::Format_ARGB32;
         case CV_8UC3:
-            fmt = QImage::Format_RGB888;
-            break;
+            return QImage::Format_RGB888;
         case CV_8UC1:
-            fmt = QImage::Format_Grayscale8;
-            break;
+            return QImage::Format_Grayscale8;
         default:
             qWarning() << "OCV2QImage: cv::Mat image type not handled in switch: " << mat.type();
-            return QImage();
+            return QImage::Format_Invalid;
     }
+}
+
+//
+// Create a openCV matrix from a qimage
+//      Works for color and grayscale
+//
+cv::Mat QImage2OCV(const QImage &img)
+{
+    cv::Mat view = QImage2OCVView(img);
+    if (view.empty())
+        return cv::Mat();
+
+    // Convert to matrix
+    cv::Mat mat;
+    if (view.type() == CV_8UC3)
+        cv::cvtColor(view, mat, CV_RGB2BGR);
+    else
+        mat = view.clone();
+    return mat;
+}
+
+//
+// Create a QImage from a openCV matrix
+//      Works for color and grayscale
+//
+QImage OCV2QImage(const cv::Mat &mat)
+{
+    QImage::Format fmt = imageFormat(mat);
+    if (fmt == QImage::Format_Invalid)
+        return QImage();
 
     // Convert to QImage
     QImage image(mat.data, mat.cols, mat.rows, static_cast<int>(mat.step), fmt);
     if (mat.type() == CV_8UC3)
-        image = image.rgbSwapped();
+        return image.rgbSwapped();
     return image.copy();
 }
+
+//
+// Read only matrix over the pixels of a qimage
+//      Nothing is copied and img is not detached. The matrix is only
+//      valid while img is alive and unchanged, and must not be written.
+//      RGB888 channels stay in RGB order.
+//
+cv::Mat QImage2OCVView(const QImage &img)
+{
+    if (img.isNull())
+        return cv::Mat();
+    int fmt = matType(img);
+    if (fmt < 0)
+        return cv::Mat();
+    return cv::Mat(img.height(), img.width(), fmt, const_cast<uchar *>(img.constBits()), img.bytesPerLine());
+}
+
+//
+// Writable matrix over the pixels of a qimage
+//      img is detached first, so writes through the matrix change img
+//      and nothing that shares its data. Valid while img is alive.
+//
+cv::Mat QImage2OCVInPlace(QImage &img)
+{
+    if (img.isNull())
+        return cv::Mat();
+    int fmt = matType(img);
+    if (fmt < 0)
+        return cv::Mat();
+    return cv::Mat(img.height(), img.width(), fmt, img.bits(), img.bytesPerLine());
+}
+
+//
+// QImage over the pixels of a matrix
+//      The image holds a reference on the matrix data, so it stays valid
+//      after mat goes away. Writing to the image detaches it. Matrices
+//      that don't own their data must outlive the image. CV_8UC3 needs
+//      its channels swapped, so it is copied.
+//
+static void releaseMat(void *info)
+{
+    delete static_cast<cv::Mat *>(info);
+}
+
+QImage OCV2QImageView(const cv::Mat &mat)
+{
+    QImage::Format fmt = imageFormat(mat);
+    if (fmt == QImage::Format_Invalid)
+        return QImage();
+    if (mat.type() == CV_8UC3)
+        return OCV2QImage(mat);
+
+    cv::Mat *ref = new cv::Mat(mat);
+    return QImage((const uchar *)ref->data, ref->cols, ref->rows, static_cast<int>(ref->step), fmt, releaseMat, ref);
+}
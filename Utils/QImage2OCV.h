@@ -8,6 +8,12 @@
 #include <QDebug>
 #include <QImage>
 
-cv::Mat QImage2OCV(QImage &img);
-QImage OCV2QImage(cv::Mat &inMat);
+// Copying conversions, the result owns its pixels
+cv::Mat QImage2OCV(const QImage &img);
+QImage OCV2QImage(const cv::Mat &mat);
+
+// Views that share pixels instead of copying them
+cv::Mat QImage2OCVView(const QImage &img);
+cv::Mat QImage2OCVInPlace(QImage &img);
+QImage OCV2QImageView(const cv::Mat &mat);
 #endif
@@ -1,5 +1,6 @@
 #include "Config.h"
 #include "Viewer.h"
+#include "PageItem.h"
 #include "Utils/QImage2OCV.h"
 #include <QDebug>
 #include <QInputDialog>
@@ -8,6 +9,7 @@
 #include <QMouseEvent>
 #include <QPainter>
 #include <QScrollBar>
+#include <QtConcurrent/QtConcurrent>
 
 Viewer::Viewer(QWidget * parent) : QWidget(parent)
 {
@@ -27,10 +29,16 @@ Viewer::Viewer(QWidget * parent) : QWidget(parent)
     DropperCursor = QCursor(p, 0, 31);
     p = QPixmap(":/images/assets/despeckle.svg").scaled(32,32,Qt::KeepAspectRatio);
     DespeckleCursor = QCursor(p, 15, 15);
+
+    // Background jobs
+    connect(&binaryWatcher, &QFutureWatcher<QImage>::finished, this, &Viewer::binaryFinished);
+    connect(&previewWatcher, &QFutureWatcher<Preview>::finished, this, &Viewer::previewFinished);
 }
 
 Viewer::~Viewer()
 {
+    binaryWatcher.waitForFinished();
+    previewWatcher.waitForFinished();
     if (tessApi != nullptr)
     {
         tessApi->End();
@@ -66,6 +74,7 @@ void Viewer::leaveEvent(QEvent *event)
 //
 void Viewer::mousePressEvent(QMouseEvent *event)
 {
+    finishJobs();
     if (currPage.m_img.isNull())
         return;
 
@@ -95,7 +104,7 @@ void Viewer::mousePressEvent(QMouseEvent *event)
         else if ((leftMode == Pencil) || (leftMode == Eraser))
         {
             currColor = (leftMode == Pencil) ? Config::fgColor : Config::bgColor;
-            currPage.push();
+            currPage.push(QRect());
             if (!shift)
                 drawDot(leftOrigin, currColor);
             flag = true;
@@ -149,14 +158,16 @@ void Viewer::mouseMoveEvent(QMouseEvent *event)
     // If pasting, update location
     if (pasting)
     {
+        QRect oldRect = pasteRect();
         pasteLoc = pasteLocator(event->pos(), ctrl);
-        update();
+        update(oldRect | pasteRect());
         flag = true;
     }
     else if (leftMode == PlaceRef)
     {
+        updateCrosshair(cursorPos);
         cursorPos = event->pos();
-        update();
+        updateCrosshair(cursorPos);
         flag = true;
     }
 
@@ -173,12 +184,16 @@ void Viewer::mouseMoveEvent(QMouseEvent *event)
         {
             if (shift)
             {
+                QRect oldRect = shiftPencil ? strokeRect(leftOrigin, drawLoc) : QRect();
                 shiftPencil = true;
                 drawLoc = event->pos();
-                update();
+                update(oldRect | strokeRect(leftOrigin, drawLoc));
             }
             else
             {
+                // Erase the rubber band line if shift was just released
+                if (shiftPencil)
+                    update(strokeRect(leftOrigin, drawLoc));
                 shiftPencil = false;
                 drawLine(leftOrigin, event->pos(), currColor);
                 leftOrigin = event->pos();
@@ -223,6 +238,7 @@ void Viewer::mouseMoveEvent(QMouseEvent *event)
 //
 void Viewer::mouseReleaseEvent(QMouseEvent *event)
 {
+    finishJobs();
     if (currPage.m_img.isNull())
         return;
 
@@ -249,8 +265,7 @@ void Viewer::mouseReleaseEvent(QMouseEvent *event)
         {
             shiftPencil = false;
             drawLine(leftOrigin, event->pos(), currColor);
-            currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-            emit updateIconSig();
+            commitPage();
             flag = true;
         }
         else if (leftMode == ColorSelect)
@@ -320,8 +335,7 @@ void Viewer::mouseReleaseEvent(QMouseEvent *event)
             p.end();
 
             // Update icon
-            currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-            emit updateIconSig();
+            commitPage();
             update();
             flag = true;
         }
@@ -400,6 +414,7 @@ Viewer::MatchCode Viewer::keyMatches(QKeyEvent *event, QKeySequence::StandardKey
 //
 void Viewer::keyPressEvent(QKeyEvent *event)
 {
+    finishJobs();
     if (currPage.m_img.isNull())
         return;
 
@@ -426,8 +441,7 @@ void Viewer::keyPressEvent(QKeyEvent *event)
     else if (event->matches(QKeySequence::Undo))
     {
         bool updateZoom = currPage.undo();
-        currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-        emit updateIconSig();
+        commitPage();
         if (updateZoom)
             fitWindow();
         update();
@@ -436,8 +450,7 @@ void Viewer::keyPressEvent(QKeyEvent *event)
     else if (event->matches(QKeySequence::Redo))
     {
         bool updateZoom = currPage.redo();
-        currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-        emit updateIconSig();
+        commitPage();
         if (updateZoom)
             fitWindow();
         update();
@@ -448,10 +461,9 @@ void Viewer::keyPressEvent(QKeyEvent *event)
         if (!pageMask.isNull())
         {
             blinkTimer->stop();
-            currPage.push();
+            currPage.push(Page::maskRect(pageMask));
             currPage.applyMask(pageMask, Config::bgColor);
-            currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-            emit updateIconSig();
+            commitPage();
             resetTools();
             update();
         }
@@ -474,10 +486,9 @@ void Viewer::keyPressEvent(QKeyEvent *event)
         if (!pageMask.isNull())
         {
             blinkTimer->stop();
-            currPage.push();
+            currPage.push(Page::maskRect(pageMask));
             currPage.applyMask(pageMask, Config::fgColor);
-            currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-            emit updateIconSig();
+            commitPage();
             resetTools();
             update();
         }
@@ -515,12 +526,11 @@ void Viewer::keyPressEvent(QKeyEvent *event)
     }
     else if (keyMatches(event, QKeySequence::Paste) != None)
     {
-        if (!deskewImg.isNull())
+        if (deskewPreview)
         {
             currPage.push();
-            currPage.applyDeskew(deskewImg);
-            currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-            emit updateIconSig();
+            currPage.applyDeskew(Config::deskewAngle);
+            commitPage();
             leftMode = Select;
             resetTools();
             update();
@@ -599,7 +609,7 @@ void Viewer::keyPressEvent(QKeyEvent *event)
         update();
         flag = true;
     }
-    else if (!deskewImg.isNull())
+    else if (deskewPreview)
     {
         if (key == Qt::Key_Down)
         {
@@ -669,8 +679,10 @@ void Viewer::keyReleaseEvent(QKeyEvent *event)
 
 //
 // Replace paintEvent to get proper scaling of image
+//     The page and mask are drawn from tile pyramids so only the exposed
+//     area is resampled, from the level nearest the zoom
 //
-void Viewer::paintEvent(QPaintEvent *)
+void Viewer::paintEvent(QPaintEvent *event)
 {
     QPainter p(this);
 
@@ -685,8 +697,9 @@ void Viewer::paintEvent(QPaintEvent *)
             rightBand->setGeometry(QRect(pageToScrn.map(RMRBstart), pageToScrn.map(RMRBend)).normalized());
 
         // Draw page
+        pageTiles.invalidate(currPage.m_img, currPage.takeDirty());
+        pageTiles.draw(p, currPage.m_img, scaleFactor, event->rect());
         p.setTransform(pageToScrn);
-        p.drawImage(currPage.m_img.rect().topLeft(), currPage.m_img);
 
         // Additions to page
         if (pasting)
@@ -696,14 +709,24 @@ void Viewer::paintEvent(QPaintEvent *)
         }
         else if (!pageMask.isNull())
         {
-            p.drawImage(QPoint(0,0), pageMask);
+            if (blinkState != 0)
+            {
+                TileCache &tiles = maskTiles[blinkState - 1];
+                QColor color = (blinkState == 1) ? Config::fgColor : Config::bgColor;
+                tiles.setColors({ color.rgba(), qRgba(0,0,0,0) });
+                tiles.invalidate(pageMask, pageMask.rect());
+                tiles.draw(p, pageMask, scaleFactor, event->rect());
+            }
         }
-        else if (!deskewImg.isNull())
+        else if (deskewPreview)
         {
-            // Draw deskewed image rotated about the center
-            QRect rect(deskewImg.rect());
-            rect.moveCenter(currPage.m_img.rect().center());
-            p.drawImage(rect.topLeft(), deskewImg);
+            // Draw the page again rotated about its center, from the
+            // screen resolution tiles so the angle can change freely
+            QPointF center = QPointF(currPage.m_img.rect().center()) * scaleFactor;
+            QTransform rotate = QTransform().translate(center.x(), center.y())
+                    .rotate(Config::deskewAngle).translate(-center.x(), -center.y());
+            p.setTransform(QTransform());
+            pageTiles.draw(p, currPage.m_img, scaleFactor, event->rect(), rotate);
 
             // Draw alignment grid
             p.setTransform(QTransform());           // Reset to view coordinates
@@ -751,21 +774,35 @@ void Viewer::paintEvent(QPaintEvent *)
 //
 void Viewer::changePage(QListWidgetItem *curr)
 {
+    // Results of running jobs belong to the current page
+    finishJobs();
+
+    pageTiles.clear();
+    distMap = QImage();
+
     // Save current view
     if (currItem != nullptr)
     {
-        currPage = currItem->data(Qt::UserRole).value<Page>();
-        currPage.scaleFactor = scaleFactor;
-        currPage.horizontalScroll = scrollArea->horizontalScrollBar()->value();
-        currPage.verticalScroll = scrollArea->verticalScrollBar()->value();
-        currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
+        Page &page = PageItem::pageOf(currItem);
+        page.scaleFactor = scaleFactor;
+        page.horizontalScroll = scrollArea->horizontalScrollBar()->value();
+        page.verticalScroll = scrollArea->verticalScrollBar()->value();
     }
 
     // Load new page
     if (curr != nullptr)
     {
         currItem = curr;
-        currPage = currItem->data(Qt::UserRole).value<Page>();
+        Page &page = PageItem::pageOf(currItem);
+
+        // Read lazily imported pages on first view
+        if (!page.loaded())
+        {
+            QGuiApplication::setOverrideCursor(Qt::WaitCursor);
+            page.load();
+            QGuiApplication::restoreOverrideCursor();
+        }
+        currPage = page;
 
         // Restore view position
         if (currPage.scaleFactor != 0.0)
@@ -804,9 +841,11 @@ void Viewer::changePage(QListWidgetItem *curr)
 //
 void Viewer::updatePage(bool updateZoom)
 {
+    finishJobs();
     if (currItem == nullptr)
         return;
-    currPage = currItem->data(Qt::UserRole).value<Page>();
+    currPage = PageItem::pageOf(currItem);
+    pageTiles.clear();
     if (updateZoom)
         fitWindow();
     resetTools();
@@ -818,6 +857,7 @@ void Viewer::updatePage(bool updateZoom)
 //
 void Viewer::setTool(LeftMode tool)
 {
+    finishJobs();
     if (Config::multiPage)
     {
         leftMode = Select;
@@ -854,9 +894,15 @@ void Viewer::setTool(LeftMode tool)
     else if (tool == Deskew)
     {
         setCursor(Qt::ArrowCursor);
-        Config::deskewAngle = currPage.calcDeskew();
-        emit setDeskewSig(Config::deskewAngle + 0.05);
-        emit setDeskewSig(Config::deskewAngle);
+        startPreview([](Page page, const Preview &) {
+            Preview result;
+            float conf;
+            qint64 msecs;
+            result.angle = page.calcDeskew(true, &conf, &msecs);
+            result.status = QStringLiteral("Skew %1, confidence %2, %3 ms")
+                    .arg(result.angle, 0, 'f', 2).arg(conf, 0, 'f', 1).arg(msecs);
+            return result;
+        });
     }
     else if ((tool == PlaceRef) || (tool == LocateRef))
         setCursor(Qt::CrossCursor);
@@ -871,12 +917,24 @@ void Viewer::setTool(LeftMode tool)
 void Viewer::resetTools()
 {
     pasting = false;
-    deskewImg = QImage();
+    deskewPreview = false;
     pageMask = QImage();
+    blinkState = 0;
     emit statusSig("");
     update();
 }
 
+//
+// Store the edited page in its item and refresh the part of the
+// icon that changed
+//
+void Viewer::commitPage()
+{
+    QRect dirty = currPage.takeIconDirty();
+    PageItem::pageOf(currItem) = currPage;
+    emit updateIconSig(dirty);
+}
+
 //
 // Draw a line in the foreground color
 //
@@ -885,12 +943,16 @@ void Viewer::drawLine(QPoint start, QPoint finish, QColor color)
     if (currPage.m_img.isNull())
         return;
 
+    // Save what the stroke will cover
+    int pad = Config::brushSize + 1;
+    currPage.extend(scrnToPage.mapRect(QRect(start, finish).normalized()).adjusted(-pad, -pad, pad, pad));
+
     QPainter p(&currPage.m_img);
     p.setTransform(scrnToPage);
     p.setPen(QPen(color, int(Config::brushSize * scaleFactor + 0.5), Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
     p.drawLine(start, finish);
     p.end();
-    update();
+    update(strokeRect(start, finish));
 }
 
 //
@@ -901,6 +963,11 @@ void Viewer::drawDot(QPoint loc, QColor color)
     if (currPage.m_img.isNull())
         return;
 
+    // Save what the dot will cover
+    int pad = Config::brushSize + 1;
+    QPoint center = scrnToPageOffs.map(loc);
+    currPage.extend(QRect(center, center).adjusted(-pad, -pad, pad, pad));
+
     // Ellipse doesn't work well for single pixels
     if (Config::brushSize == 1)
     {
@@ -916,7 +983,35 @@ void Viewer::drawDot(QPoint loc, QColor color)
         p.drawEllipse(loc, int(Config::brushSize * scaleFactor/2.0 + 0.5), int(Config::brushSize * scaleFactor/2.0 + 0.5));
         p.end();
     }
-    update();
+    update(strokeRect(loc, loc));
+}
+
+//
+// Screen area covered by a pencil stroke between two screen points
+//
+QRect Viewer::strokeRect(QPoint start, QPoint finish)
+{
+    int pad = int(Config::brushSize * scaleFactor / 2.0 + 0.5) + 2;
+    return QRect(start, finish).normalized().adjusted(-pad, -pad, pad, pad);
+}
+
+//
+// Screen area covered by the paste preview
+//
+QRect Viewer::pasteRect()
+{
+    if (!pasting || copyImage.isNull())
+        return QRect();
+    return pageToScrn.mapRect(QRect(pasteLoc, copyImage.size())).adjusted(-2, -2, 2, 2);
+}
+
+//
+// Repaint the strips under the PlaceRef crosshair
+//
+void Viewer::updateCrosshair(QPoint pos)
+{
+    update(QRect(0, pos.y() - 1, width(), 3));
+    update(QRect(pos.x() - 1, 0, 3, height()));
 }
 
 //
@@ -927,7 +1022,10 @@ void Viewer::fillArea(QRect rect, QColor color, bool outside)
     if (currPage.m_img.isNull())
         return;
 
-    currPage.push();
+    if (outside)
+        currPage.push();
+    else
+        currPage.push(scrnToPage.mapRect(rect).adjusted(-1, -1, 1, 1));
     QPainter p(&currPage.m_img);
     if (outside)
     {
@@ -946,8 +1044,7 @@ void Viewer::fillArea(QRect rect, QColor color, bool outside)
         p.fillRect(rect, color);
     }
     p.end();
-    currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-    emit updateIconSig();
+    commitPage();
     update();
 }
 
@@ -1048,7 +1145,7 @@ void Viewer::doPaste(bool transparent)
     // Cleanup
     pasting = false;
     setMouseTracking(false);
-    currPage.push();
+    currPage.push(QRect(pasteLoc, copyImage.size()));
 
     // Bump copyImage to head of list
     int idx = copyImageList.indexOf(copyImage);
@@ -1080,8 +1177,7 @@ void Viewer::doPaste(bool transparent)
     else
         p.drawImage(pasteLoc, copyImage);
     p.end();
-    currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-    emit updateIconSig();
+    commitPage();
     update();
 }
 
@@ -1107,13 +1203,13 @@ QPoint Viewer::pasteLocator(QPoint mouse, bool optimize)
         QImage tmp1 = currPage.m_img.copy(loc.x() - win, loc.y() - win, imgW + win*2, imgH + win*2);
         if (tmp1.format() != QImage::Format_Grayscale8)
             tmp1 = tmp1.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
-        cv::Mat mat1 = QImage2OCV(tmp1);
+        cv::Mat mat1 = QImage2OCVView(tmp1);
 
         // Convert paste image to grayscale
         QImage tmp2 = copyImage;
         if (tmp2.format() != QImage::Format_Grayscale8)
             tmp2 = tmp2.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
-        cv::Mat mat2 = QImage2OCV(tmp2);
+        cv::Mat mat2 = QImage2OCVView(tmp2);
 
         // Make a target array
         cv::Mat res;
@@ -1137,9 +1233,13 @@ QPoint Viewer::pasteLocator(QPoint mouse, bool optimize)
 //
 void Viewer::doRecolor(QRect box)
 {
-    currPage.push();
     if (currPage.m_img.format() != QImage::Format_RGB32)
+    {
+        currPage.push();
         currPage.m_img = currPage.m_img.convertToFormat(QImage::Format_RGB32);
+    }
+    else
+        currPage.push(box);
 
     // clip region to image dimensions
     int top = std::max(box.top(), 0);
@@ -1160,8 +1260,7 @@ void Viewer::doRecolor(QRect box)
                 *srcPtr++ = Config::fgColor.rgba();
         }
     }
-    currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-    emit updateIconSig();
+    commitPage();
     update();
 }
 
@@ -1172,6 +1271,7 @@ void Viewer::doDropper()
 {
     if (leftMode != ColorSelect)
         return;
+    finishBinary();
 
     // Legalize point to inside image
     QPoint loc = scrnToPageOffs.map(leftOrigin);
@@ -1180,11 +1280,34 @@ void Viewer::doDropper()
 
     // Get pixel under cursor
     QRgb pixel = currPage.m_img.pixel(loc);
-    blinkTimer->stop();
-    resetTools();
-    pageMask = currPage.colorSelect(pixel, Config::dropperThreshold);
-    blinkTimer->start(300);
-    update();
+    int threshold = Config::dropperThreshold;
+    startPreview([pixel, threshold](Page page, const Preview &cache) {
+        return selectMask(page, cache, pixel, threshold);
+    });
+}
+
+//
+// Select pixels near the target color
+//     The distance map is kept until the page or target changes, so
+//     scrubbing the threshold only redoes the cheap thresholding pass
+//
+Viewer::Preview Viewer::selectMask(Page &page, const Preview &cache, QRgb target, int threshold)
+{
+    Preview result;
+    if (cache.dist.isNull() || (cache.distKey != page.m_img.cacheKey()) || (cache.distTarget != target))
+    {
+        result.dist = page.distanceMap(target);
+        result.distKey = page.m_img.cacheKey();
+        result.distTarget = target;
+    }
+    else
+    {
+        result.dist = cache.dist;
+        result.distKey = cache.distKey;
+        result.distTarget = cache.distTarget;
+    }
+    result.mask = Page::thresholdMask(result.dist, threshold);
+    return result;
 }
 
 //
@@ -1193,6 +1316,7 @@ void Viewer::doDropper()
 void Viewer::deColor()
 {
     bool ok;
+    finishJobs();
     blinkTimer->stop();
     resetTools();
     Config::deColorDist = QInputDialog::getInt(this, "De-color distance",
@@ -1209,17 +1333,19 @@ void Viewer::doFlood()
 {
     if (leftMode != FloodFill)
         return;
+    finishBinary();
 
     // Legalize point to inside image
     QPoint loc = scrnToPageOffs.map(leftOrigin);
     loc.setX(std::min( std::max(loc.x(), 0), currPage.m_img.width()-1) );
     loc.setY(std::min( std::max(loc.y(), 0), currPage.m_img.height()-1) );
 
-    blinkTimer->stop();
-    resetTools();
-    pageMask = currPage.floodFill(loc, Config::floodThreshold);
-    blinkTimer->start(300);
-    update();
+    int threshold = Config::floodThreshold;
+    startPreview([loc, threshold](Page page, const Preview &) {
+        Preview result;
+        result.mask = page.floodFill(loc, threshold);
+        return result;
+    });
 }
 
 //
@@ -1229,12 +1355,12 @@ void Viewer::doRemoveBG()
 {
     if (leftMode != RemoveBG)
         return;
+    finishBinary();
 
-    blinkTimer->stop();
-    resetTools();
-    pageMask = currPage.colorSelect(QColor(Qt::white).rgb(), Config::bgRemoveThreshold);
-    blinkTimer->start(300);
-    update();
+    int threshold = Config::bgRemoveThreshold;
+    startPreview([threshold](Page page, const Preview &cache) {
+        return selectMask(page, cache, QColor(Qt::white).rgb(), threshold);
+    });
 }
 
 //
@@ -1242,17 +1368,16 @@ void Viewer::doRemoveBG()
 //
 void Viewer::doDespeckle()
 {
-    int blobs;
-
     if (leftMode != Despeckle)
         return;
-
-    blinkTimer->stop();
-    resetTools();
-    pageMask = currPage.despeckle(Config::despeckleArea, false, &blobs);
-    emit statusSig(QStringLiteral("%1 blobs").arg(blobs));
-    blinkTimer->start(300);
-    update();
+    finishBinary();
+
+    int area = Config::despeckleArea;
+    startPreview([area](Page page, const Preview &) {
+        Preview result;
+        result.mask = page.despeckle(area, false, &result.blobs);
+        return result;
+    });
 }
 
 //
@@ -1260,34 +1385,120 @@ void Viewer::doDespeckle()
 //
 void Viewer::doDevoid()
 {
-    int blobs;
-
     if (leftMode != Devoid)
         return;
+    finishBinary();
+
+    int area = Config::devoidArea;
+    startPreview([area](Page page, const Preview &) {
+        Preview result;
+        result.mask = page.despeckle(area, true, &result.blobs);
+        return result;
+    });
+}
+
+//
+// Compute a preview in the background
+//     Only one runs at a time. Requests made meanwhile replace each
+//     other, so only the latest one is started when it finishes and
+//     input never waits behind stale work.
+//
+void Viewer::startPreview(PreviewJob job)
+{
+    // Remember which tool asked, the answer is dropped if it changes
+    LeftMode mode = leftMode;
+    runPreview([job, mode](Page page, const Preview &cache) {
+        Preview result = job(page, cache);
+        result.mode = mode;
+        return result;
+    });
+}
+
+void Viewer::runPreview(PreviewJob job)
+{
+    if (previewActive)
+    {
+        previewPending = job;
+        return;
+    }
+
+    Preview cache;
+    cache.dist = distMap;
+    cache.distTarget = distTarget;
+    cache.distKey = distKey;
+    Page page = currPage;
+    qint64 key = currPage.m_img.cacheKey();
+    previewWatcher.setFuture(QtConcurrent::run([job, page, cache, key]() {
+        Preview result = job(page, cache);
+        result.key = key;
+        return result;
+    }));
+    previewActive = true;
+}
+
+//
+// Show the finished preview unless something newer is waiting
+//
+void Viewer::previewFinished()
+{
+    // Ignore stale notifications
+    if (!previewActive || !previewWatcher.isFinished())
+        return;
+    previewActive = false;
+    Preview result = previewWatcher.result();
+
+    // Keep the distance map for the next threshold change
+    if (!result.dist.isNull() && (result.distKey == currPage.m_img.cacheKey()))
+    {
+        distMap = result.dist;
+        distTarget = result.distTarget;
+        distKey = result.distKey;
+    }
+
+    // A newer request makes this result stale
+    if (previewPending)
+    {
+        PreviewJob job = previewPending;
+        previewPending = nullptr;
+        runPreview(job);
+        return;
+    }
+
+    // The page or tool may have changed meanwhile
+    if ((result.mode != leftMode) || (result.key != currPage.m_img.cacheKey()))
+        return;
+
+    if (result.mode == Deskew)
+    {
+        deskewStatus = result.status;
+        Config::deskewAngle = result.angle;
+        emit setDeskewSig(Config::deskewAngle + 0.05);
+        emit setDeskewSig(Config::deskewAngle);
+        return;
+    }
 
     blinkTimer->stop();
     resetTools();
-    pageMask = currPage.despeckle(Config::devoidArea, true, &blobs);
-    emit statusSig(QStringLiteral("%1 blobs").arg(blobs));
+    pageMask = result.mask;
+    if (result.blobs >= 0)
+        emit statusSig(QStringLiteral("%1 blobs").arg(result.blobs));
     blinkTimer->start(300);
     update();
 }
 
 //
 // Update image based on deskew angle
+//     The preview is drawn rotated from the screen tiles in paintEvent,
+//     the page itself is only rotated when it is applied
 //
 void Viewer::doDeskew()
 {
     if (leftMode != Deskew)
         return;
 
-    // resetTools erases current deskewImg causes annoying flicker
-    QImage tmp = deskewImg;
     resetTools();
-    deskewImg = tmp;
-
-    // Compute new deskew image
-    deskewImg = currPage.deskew(Config::deskewAngle);
+    deskewPreview = true;
+    emit statusSig(deskewStatus);
     update();
 }
 
@@ -1296,6 +1507,7 @@ void Viewer::doDeskew()
 //
 void Viewer::toGrayscale()
 {
+    finishJobs();
     if (currPage.m_img.isNull())
         return;
     if (Config::multiPage)
@@ -1303,8 +1515,7 @@ void Viewer::toGrayscale()
 
     currPage.push();
     currPage.toGrayscale();
-    currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-    emit updateIconSig();
+    commitPage();
     update();
 }
 
@@ -1318,15 +1529,13 @@ void Viewer::toBinary()
     if (Config::multiPage)
         return;
 
-    // If last operation converted to mono, undo it
-    if ((currPage.m_img.format() == QImage::Format_Mono) && (currPage.peek().format() != QImage::Format_Mono))
-        currPage.undo();
-
-    currPage.push();
-    currPage.toBinary(false, Config::blurRadius);
-    currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-    emit updateIconSig();
-    update();
+    // Only one conversion at a time, remember the latest request
+    if (binaryActive != NoBinary)
+    {
+        binaryPending = Binary;
+        return;
+    }
+    startBinary(false);
 }
 
 //
@@ -1339,15 +1548,51 @@ void Viewer::toAdaptive()
     if (Config::multiPage)
         return;
 
+    // Only one conversion at a time, remember the latest request
+    if (binaryActive != NoBinary)
+    {
+        binaryPending = Adaptive;
+        return;
+    }
+    startBinary(true);
+}
+
+//
+// Start binary conversion in the background
+//
+void Viewer::startBinary(bool adaptive)
+{
     // If last operation converted to mono, undo it
-    if ((currPage.m_img.format() == QImage::Format_Mono) && (currPage.peek().format() != QImage::Format_Mono))
+    if ((currPage.m_img.format() == QImage::Format_Mono) && (currPage.peekFormat() != QImage::Format_Mono))
         currPage.undo();
 
     currPage.push();
-    currPage.toBinary(true, Config::adaptiveBlurRadius, Config::kernelSize);
-    currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-    emit updateIconSig();
+    if (adaptive)
+        binaryWatcher.setFuture(currPage.toBinaryAsync(true, Config::adaptiveBlurRadius, Config::kernelSize));
+    else
+        binaryWatcher.setFuture(currPage.toBinaryAsync(false, Config::blurRadius));
+    binaryActive = adaptive ? Adaptive : Binary;
+}
+
+//
+// Store the binary image into the page
+//
+void Viewer::binaryFinished()
+{
+    // Ignore stale notifications
+    if ((binaryActive == NoBinary) || !binaryWatcher.isFinished())
+        return;
+    binaryActive = NoBinary;
+
+    currPage.m_img = binaryWatcher.result();
+    commitPage();
     update();
+
+    // Catch up with the spinboxes
+    BinaryMode mode = binaryPending;
+    binaryPending = NoBinary;
+    if (mode != NoBinary)
+        startBinary(mode == Adaptive);
 }
 
 //
@@ -1355,19 +1600,19 @@ void Viewer::toAdaptive()
 //
 void Viewer::toDithered()
 {
+    finishJobs();
     if (currPage.m_img.isNull())
         return;
     if (Config::multiPage)
         return;
 
     // If last operation converted to mono, undo it
-    if ((currPage.m_img.format() == QImage::Format_Mono) && (currPage.peek().format() != QImage::Format_Mono))
+    if ((currPage.m_img.format() == QImage::Format_Mono) && (currPage.peekFormat() != QImage::Format_Mono))
         currPage.undo();
 
     currPage.push();
     currPage.toDithered();
-    currItem->setData(Qt::UserRole, QVariant::fromValue(currPage));
-    emit updateIconSig();
+    commitPage();
     update();
 }
 
@@ -1400,9 +1645,9 @@ void Viewer::doRegionOCR(QRect rect)
     if (img.format() != QImage::Format_Grayscale8)
         img = img.convertToFormat(QImage::Format_Grayscale8, Qt::ThresholdDither);
 
-    // Convert to OpenCV
+    // View as OpenCV
     cv::Mat mat, bw;
-    mat = QImage2OCV(img);
+    mat = QImage2OCVView(img);
     cv::threshold(mat, bw, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
 
     // OCR the selection
@@ -1417,6 +1662,36 @@ void Viewer::doRegionOCR(QRect rect)
     QGuiApplication::restoreOverrideCursor();
 }
 
+//
+// Wait for background jobs and apply their results
+//     Called before anything that reads or edits the page
+//
+void Viewer::finishJobs()
+{
+    while ((binaryActive != NoBinary) || previewActive)
+    {
+        finishBinary();
+        if (previewActive)
+        {
+            previewWatcher.waitForFinished();
+            previewFinished();
+        }
+    }
+}
+
+//
+// Wait only for binary conversions, which change the page
+//     Previews keep running, they are replaced by newer requests
+//
+void Viewer::finishBinary()
+{
+    while (binaryActive != NoBinary)
+    {
+        binaryWatcher.waitForFinished();
+        binaryFinished();
+    }
+}
+
 //
 // Blink mask to make it easier to see
 //
@@ -1427,10 +1702,7 @@ void Viewer::blinker()
         blinkTimer->stop();
         return;
     }
-    if (pageMask.color(0) != Config::fgColor.rgba())
-        pageMask.setColor( 0, Config::fgColor.rgba() );
-    else
-        pageMask.setColor( 0, Config::bgColor.rgba() );
+    blinkState = (blinkState == 1) ? 2 : 1;
     update();
 }
 
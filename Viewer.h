@@ -2,14 +2,17 @@
 #define VIEWER_H
 
 #include "Page.h"
+#include "TileCache.h"
 #include <QApplication>
 #include <QClipboard>
 #include <QEnterEvent>
+#include <QFutureWatcher>
 #include <QImage>
 #include <QListWidget>
 #include <QScrollArea>
 #include <QTimer>
 #include <QWidget>
+#include <functional>
 #include <tesseract/baseapi.h>
 
 class Viewer : public QWidget
@@ -30,6 +33,7 @@ public slots:
     void updatePage(bool updateZoom);
     void setTool(LeftMode tool);
     void resetTools();
+    void finishJobs();
 
     void doDropper();
     void deColor();
@@ -53,7 +57,7 @@ public slots:
 
 signals:
     void setDeskewSig(float val);
-    void updateIconSig();
+    void updateIconSig(QRect dirty);
     void zoomSig();
     void statusSig(QString descr);
 
@@ -74,16 +78,42 @@ protected:
     QSize sizeHint() const override;
 
 private:
+    // Result of a preview computed in the background
+    struct Preview
+    {
+        LeftMode mode = Select;     // Tool that asked for it
+        qint64 key = 0;             // cacheKey of the page it was made from
+        QImage mask;
+        int blobs = -1;
+        float angle = 0.0;
+        QString status;
+        QImage dist;                // Distance map, kept for the next threshold change
+        QRgb distTarget = 0;
+        qint64 distKey = 0;
+    };
+    typedef std::function<Preview(Page page, const Preview &cache)> PreviewJob;
+
     MatchCode keyMatches(QKeyEvent *event, QKeySequence::StandardKey matchKey);
+    void commitPage();
     void drawLine(QPoint start, QPoint finish, QColor color);
     void drawDot(QPoint loc, QColor color);
+    QRect strokeRect(QPoint start, QPoint finish);
+    QRect pasteRect();
+    void updateCrosshair(QPoint pos);
     void fillArea(QRect rect, QColor color, bool outside);
     void doCopy(QRect box);
     void setupPaste();
     void doPaste(bool transparent);
     QPoint pasteLocator(QPoint mouse, bool optimize);
     void doRecolor(QRect box);
+    static Preview selectMask(Page &page, const Preview &cache, QRgb target, int threshold);
+    void startPreview(PreviewJob job);
+    void runPreview(PreviewJob job);
+    void previewFinished();
+    void finishBinary();
     void doRegionOCR(QRect rect);
+    void startBinary(bool adaptive);
+    void binaryFinished();
 
     void zoomArea(QRect rect);
     void zoomWheel(QPointF pos, float factor);
@@ -102,6 +132,8 @@ private:
     QTransform pageToScrn;
     QTransform scrnToPage;
     QTransform scrnToPageOffs;
+    TileCache pageTiles;
+    TileCache maskTiles[2];
     QScrollArea *scrollArea = NULL;
     QRubberBand *leftBand = new QRubberBand(QRubberBand::Rectangle, this);
     QPoint LMRBstart;   // Left mouse rubberBand start
@@ -129,12 +161,26 @@ private:
     QList<QImage> copyImageList;
 
     QImage pageMask;
-    QImage deskewImg;
+    QImage distMap;         // Distance from distTarget, reused while the threshold changes
+    QRgb distTarget = 0;
+    qint64 distKey = 0;
+    int blinkState = 0;     // 0 = hidden, 1 = foreground, 2 = background
+    bool deskewPreview = false;
+    QString deskewStatus;
     int gridOffsetX = 0;
     int gridOffsetY = 0;
 
     bool locateShift;
 
+    enum BinaryMode { NoBinary, Binary, Adaptive };
+    QFutureWatcher<QImage> binaryWatcher;
+    BinaryMode binaryActive = NoBinary;
+    BinaryMode binaryPending = NoBinary;
+
+    QFutureWatcher<Preview> previewWatcher;
+    bool previewActive = false;
+    PreviewJob previewPending;
+
     tesseract::TessBaseAPI *tessApi = nullptr;
     QClipboard *clipboard = QGuiApplication::clipboard();
 };
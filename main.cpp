@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "Batch.h"
 
 #include <QApplication>
 #include <QImageReader>
@@ -13,7 +14,15 @@ int main(int argc, char *argv[])
 #else
     QCoreApplication::setApplicationName("Tiffany");
 #endif
+
+    // Headless runs don't need a display
+    bool batch = Batch::requested(argc, argv);
+    if (batch && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
     QApplication a(argc, argv);
+    if (batch)
+        return Batch::run(a.arguments());
     MainWindow w;
     w.show();
     return a.exec();
@@ -5,6 +5,7 @@
 #include <QColorDialog>
 #include <QDebug>
 #include <QFontDialog>
+#include <QInputDialog>
 #include <QMessageBox>
 
 //
@@ -46,6 +47,9 @@ void MainWindow::connectSignalSlots()
     QObject::connect( ui->openAct, &QAction::triggered, ui->bookmarks, &Bookmarks::openFiles );
     QObject::connect( ui->insertAct, &QAction::triggered, ui->bookmarks, &Bookmarks::insertFiles );
     QObject::connect( ui->replaceAct, &QAction::triggered, ui->bookmarks, &Bookmarks::replaceFiles );
+    QObject::connect( ui->lazyLoadAct, &QAction::toggled, this, [](bool val) { Config::lazyLoad = val; });
+    QObject::connect( ui->memoryAct, &QAction::triggered, this, &MainWindow::memoryBudget );
+    QObject::connect( ui->undoBudgetAct, &QAction::triggered, this, &MainWindow::undoBudget );
     QObject::connect( ui->saveFilesAct, &QAction::triggered, ui->bookmarks, &Bookmarks::saveFiles );
     QObject::connect( ui->saveToAct, &QAction::triggered, ui->bookmarks, &Bookmarks::saveToDir );
     QObject::connect( ui->exitAct, &QAction::triggered, this, &MainWindow::close );
@@ -161,6 +165,8 @@ void MainWindow::connectSignalSlots()
     QObject::connect( ui->bookmarks, &Bookmarks::changePageSig, ui->viewer, &Viewer::changePage );
     QObject::connect( ui->bookmarks, &Bookmarks::updatePageSig, ui->viewer, &Viewer::updatePage );
     QObject::connect( ui->bookmarks, &Bookmarks::progressSig, this, &MainWindow::updateProgress );
+    QObject::connect( ui->bookmarks, &Bookmarks::busySig, this, &MainWindow::setBusy );
+    QObject::connect( ui->bookmarks, &Bookmarks::syncPageSig, ui->viewer, &Viewer::finishJobs );
 
     QObject::connect( ui->viewer->blinkTimer, &QTimer::timeout, ui->viewer, &Viewer::blinker );
     QObject::connect( ui->viewer, &Viewer::updateIconSig, ui->bookmarks, &Bookmarks::updateIcon );
@@ -183,6 +189,7 @@ void MainWindow::buildToolBar()
     openToolButton->setMenu(openMenu);
     openToolButton->setDefaultAction(ui->openAct);
     ui->toolBar->addWidget(openToolButton);
+    ui->lazyLoadAct->setChecked(Config::lazyLoad);
 
     // Save button
     QMenu *saveMenu = new QMenu();
@@ -460,6 +467,30 @@ void MainWindow::fontSelect()
         Config::textFont = font;
 }
 
+//
+// Set memory allowed for pages before they are evicted
+//
+void MainWindow::memoryBudget()
+{
+    bool ok;
+    int val = QInputDialog::getInt(this, "Memory Budget",
+                "Megabytes", Config::memoryBudget, 64, 1024*1024, 64, &ok);
+    if (ok)
+        Config::memoryBudget = val;
+}
+
+//
+// Set memory each page may use for undo history
+//
+void MainWindow::undoBudget()
+{
+    bool ok;
+    int val = QInputDialog::getInt(this, "Undo Budget",
+                "Megabytes per page", Config::undoBudget, 16, 64*1024, 16, &ok);
+    if (ok)
+        Config::undoBudget = val;
+}
+
 //
 // Show progress of long operation on status bar
 //
@@ -496,6 +527,16 @@ void MainWindow::setStatus(QString descr)
         statusLabel->setText("Ready");
 }
 
+//
+// Lock out user input while a batch operation is running
+//
+void MainWindow::setBusy(bool busy)
+{
+    ui->menubar->setEnabled(!busy);
+    ui->toolBar->setEnabled(!busy);
+    ui->centralwidget->setEnabled(!busy);
+}
+
 //
 void MainWindow::about()
 {
@@ -27,8 +27,11 @@ public:
 public slots:
     void colorMagic();
     void fontSelect();
+    void memoryBudget();
+    void undoBudget();
     void updateProgress(QString descr, int val);
     void setStatus(QString descr);
+    void setBusy(bool busy);
     void about();
     void closeEvent (QCloseEvent *event);
 